@@ -10,10 +10,11 @@
 #include "data_path.hpp" //helper to get paths relative to executable
 #include "compile_program.hpp" //helper to compile opengl shader programs
 #include "draw_text.hpp" //helper to... um.. draw text
-#include "load_save_png.hpp"
+#include "load_texture.hpp"
 #include "texture_program.hpp"
 #include "depth_program.hpp"
 #include "shady_program.hpp"
+#include "frame_uniforms.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -27,7 +28,14 @@
 
 Load<MeshBuffer> meshes(LoadTagDefault, []()
 {
-    return new MeshBuffer(data_path("gateway.pnct"));
+    //(quantized, and positions in their own stream, so the depth passes fetch 8 bytes per vertex and the main pass 20,
+    // instead of 36 each)
+    MeshBuffer *ret = new MeshBuffer(data_path("gateway.qpnct"), MeshBuffer::SeparatePositions);
+    return [ret]()
+    {
+        ret->upload();
+        return ret;
+    };
 });
 
 Load<GLuint> meshes_for_texture_program(LoadTagDefault, []()
@@ -45,6 +53,26 @@ Load<GLuint> meshes_for_depth_program(LoadTagDefault, []()
     return new GLuint(meshes->make_vao_for_program(depth_program->program));
 });
 
+Load<GLuint> meshes_for_shady_program_instanced(LoadTagDefault, []()
+{
+    return new GLuint(meshes->make_vao_for_program(shady_program_instanced->program));
+});
+
+Load<GLuint> meshes_for_depth_program_instanced(LoadTagDefault, []()
+{
+    return new GLuint(meshes->make_vao_for_program(depth_program_instanced->program));
+});
+
+Load<GLuint> meshes_for_shady_program_multidraw(LoadTagDefault, []()
+{
+    return new GLuint(meshes->make_vao_for_program(shady_program_multidraw->program));
+});
+
+Load<GLuint> meshes_for_depth_program_multidraw(LoadTagDefault, []()
+{
+    return new GLuint(meshes->make_vao_for_program(depth_program_multidraw->program));
+});
+
 //used for fullscreen passes:
 Load<GLuint> empty_vao(LoadTagDefault, []()
 {
@@ -55,27 +83,6 @@ Load<GLuint> empty_vao(LoadTagDefault, []()
     return new GLuint(vao);
 });
 
-GLuint load_texture(std::string const &filename)
-{
-    glm::uvec2 size;
-    std::vector<glm::u8vec4> data;
-    load_png(filename, &size, &data, LowerLeftOrigin);
-
-    GLuint tex = 0;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    GL_ERRORS();
-
-    return tex;
-}
-
 static Scene::Transform *camera_parent_transform = nullptr;
 
 static Scene::Camera *camera = nullptr;
@@ -86,58 +93,55 @@ static Scene::Lamp *spot = nullptr;
 
 static std::vector<std::string> stone_types = {};
 
-static std::vector<GLuint *> images = {};
-
 static Scene *current_scene = nullptr;
 
-Load<GLuint> wood_tex(LoadTagDefault, []()
-{
-    return new GLuint(load_texture(data_path("textures/wood.png")));
-});
-
-Load<GLuint> marble_tex(LoadTagDefault, []()
+//decode a texture on a worker thread and upload it on the main thread:
+static std::function<std::function<GLuint const *()>()> load_texture_from(std::string const &filename)
 {
-    return new GLuint(load_texture(data_path("textures/marble.png")));
-});
+    return [filename]() -> std::function<GLuint const *()>
+    {
+        std::function<GLuint()> upload = load_texture(data_path(filename));
+        return [upload]()
+        {
+            return new GLuint(upload());
+        };
+    };
+}
 
-Load<GLuint> stone_tex(LoadTagDefault, []()
-{
-    return new GLuint(load_texture(data_path("textures/Stones_01_Atlas_Diffuse_01.png")));
-});
+Load<GLuint> wood_tex(LoadTagDefault, load_texture_from("textures/wood.png"));
 
-Load<GLuint> hourglass_neb_tex(LoadTagDefault, []()
-{
-    GLuint *tex = new GLuint(load_texture(data_path("textures/hst_hourglass_nebula.png")));
-    images.push_back(tex);
-    return tex;
-});
+Load<GLuint> marble_tex(LoadTagDefault, load_texture_from("textures/marble.png"));
 
-Load<GLuint> hst_lagoon_detail_tex(LoadTagDefault, []()
-{
-    GLuint *tex = new GLuint(load_texture(data_path("textures/hst_lagoon_detail.png")));
-    images.push_back(tex);
-    return tex;
-});
+Load<GLuint> stone_tex(LoadTagDefault, load_texture_from("textures/Stones_01_Atlas_Diffuse_01.png"));
 
-Load<GLuint> hst_orion_nebula_tex(LoadTagDefault, []()
+//images shown through the gateway, one per layer of gateway_images_tex:
+static std::vector<std::string> const &gateway_images()
 {
-    GLuint *tex = new GLuint(load_texture(data_path("textures/hst_orion_nebula.png")));
-    images.push_back(tex);
-    return tex;
-});
+    static std::vector<std::string> const images = {
+        "textures/hst_hourglass_nebula.png",
+        "textures/hst_lagoon_detail.png",
+        "textures/hst_orion_nebula.png",
+        "textures/hst_pillars_m16_close.png",
+        "textures/hst_stingray_nebula.png",
+    };
+    return images;
+}
 
-Load<GLuint> hst_pillars_m16_close_tex(LoadTagDefault, []()
-{
-    GLuint *tex = new GLuint(load_texture(data_path("textures/hst_pillars_m16_close.png")));
-    images.push_back(tex);
-    return tex;
-});
+//(the images differ in size, so each is resampled to this; a level picks its image with a layer index
+// rather than a different texture)
+static glm::uvec2 const GatewayImageSize = glm::uvec2(512, 512);
 
-Load<GLuint> hst_stingray_nebula_tex(LoadTagDefault, []()
+Load<GLuint> gateway_images_tex(LoadTagDefault, []() -> std::function<GLuint const *()>
 {
-    GLuint *tex = new GLuint(load_texture(data_path("textures/hst_stingray_nebula.png")));
-    images.push_back(tex);
-    return tex;
+    std::vector<std::string> filenames;
+    for (auto const &image : gateway_images()) {
+        filenames.emplace_back(data_path(image));
+    }
+    std::function<GLuint()> upload = load_texture_array(filenames, GatewayImageSize);
+    return [upload]()
+    {
+        return new GLuint(upload());
+    };
 });
 
 Load<GLuint> white_tex(LoadTagDefault, []()
@@ -158,52 +162,49 @@ Load<GLuint> white_tex(LoadTagDefault, []()
 
 Load<Scene> scene(LoadTagDefault, []()
 {
+    //(read and checked on a worker thread; results are only published on the main thread)
     Scene *ret = new Scene;
-    current_scene = ret;
+    std::vector<std::string> stones;
 
     //load transform hierarchy:
     ret->load(data_path("gateway.scene"), [&](Scene &s, Scene::Transform *t, std::string const &m)
     {
         if (m.find("Stone") != std::string::npos) {
-            stone_types.push_back(m);
+            stones.push_back(m);
         }
     });
 
     //look up camera parent transform:
-    for (Scene::Transform *t = ret->first_transform; t != nullptr; t = t->alloc_next) {
-        if (t->name == "CameraParent") {
-            if (camera_parent_transform) throw std::runtime_error("Multiple 'CameraParent' transforms in scene.");
-            camera_parent_transform = t;
-        }
-        if (t->name == "SpotParent") {
-            if (spot_parent_transform) throw std::runtime_error("Multiple 'SpotParent' transforms in scene.");
-            spot_parent_transform = t;
-        }
+    if (ret->lookup("CameraParent").transforms.size() > 1) throw std::runtime_error("Multiple 'CameraParent' transforms in scene.");
+    Scene::Transform *camera_parent = ret->find_transform("CameraParent");
+    if (!camera_parent) throw std::runtime_error("No 'CameraParent' transform in scene.");
 
-    }
-    if (!camera_parent_transform) throw std::runtime_error("No 'CameraParent' transform in scene.");
-    if (!spot_parent_transform) throw std::runtime_error("No 'SpotParent' transform in scene.");
+    //look up spot parent transform:
+    if (ret->lookup("SpotParent").transforms.size() > 1) throw std::runtime_error("Multiple 'SpotParent' transforms in scene.");
+    Scene::Transform *spot_parent = ret->find_transform("SpotParent");
+    if (!spot_parent) throw std::runtime_error("No 'SpotParent' transform in scene.");
 
     //look up the camera:
-    for (Scene::Camera *c = ret->first_camera; c != nullptr; c = c->alloc_next) {
-        if (c->transform->name == "Camera") {
-            if (camera) throw std::runtime_error("Multiple 'Camera' objects in scene.");
-            camera = c;
-        }
-    }
-    if (!camera) throw std::runtime_error("No 'Camera' camera in scene.");
+    if (ret->lookup("Camera").cameras.size() > 1) throw std::runtime_error("Multiple 'Camera' objects in scene.");
+    Scene::Camera *scene_camera = ret->find_camera("Camera");
+    if (!scene_camera) throw std::runtime_error("No 'Camera' camera in scene.");
 
     //look up the spotlight:
-    for (Scene::Lamp *l = ret->first_lamp; l != nullptr; l = l->alloc_next) {
-        if (l->transform->name == "Spot") {
-            if (spot) throw std::runtime_error("Multiple 'Spot' objects in scene.");
-            if (l->type != Scene::Lamp::Spot) throw std::runtime_error("Lamp 'Spot' is not a spotlight.");
-            spot = l;
-        }
-    }
-    if (!spot) throw std::runtime_error("No 'Spot' spotlight in scene.");
+    if (ret->lookup("Spot").lamps.size() > 1) throw std::runtime_error("Multiple 'Spot' objects in scene.");
+    Scene::Lamp *scene_spot = ret->find_lamp("Spot");
+    if (!scene_spot) throw std::runtime_error("No 'Spot' spotlight in scene.");
+    if (scene_spot->type != Scene::Lamp::Spot) throw std::runtime_error("Lamp 'Spot' is not a spotlight.");
 
-    return ret;
+    return [=]()
+    {
+        current_scene = ret;
+        stone_types.insert(stone_types.end(), stones.begin(), stones.end());
+        camera_parent_transform = camera_parent;
+        spot_parent_transform = spot_parent;
+        camera = scene_camera;
+        spot = scene_spot;
+        return ret;
+    };
 });
 
 GameMode::GameMode()
@@ -216,19 +217,27 @@ GameMode::GameMode()
       distribution_time(0.0f, 1.0f),
       distribution_angle(0.0f, 360.f),
       distribution_mesh(0, stone_types.size() - 1),
-      distribution_images(0, images.size() - 1)
+      distribution_images(0, uint32_t(gateway_images().size()) - 1)
 {
     Scene::Object::ProgramInfo shady_program_info;
     shady_program_info.program = shady_program->program;
     shady_program_info.vao = *meshes_for_shady_program;
-    shady_program_info.mvp_mat4 = shady_program->object_to_clip_mat4;
-    shady_program_info.mv_mat4 = shady_program->object_to_light_mat4;
-    shady_program_info.itmv_mat3 = shady_program->normal_to_light_mat3;
+    shady_program_info.object_block = true;
+    shady_program_info.instanced_program = shady_program_instanced->program;
+    shady_program_info.instanced_vao = *meshes_for_shady_program_instanced;
+    shady_program_info.instanced_light_to_clip_mat4 = shady_program_instanced->light_to_clip_mat4;
+    shady_program_info.multidraw_program = shady_program_multidraw->program;
+    shady_program_info.multidraw_vao = *meshes_for_shady_program_multidraw;
 
     Scene::Object::ProgramInfo depth_program_info;
     depth_program_info.program = depth_program->program;
     depth_program_info.vao = *meshes_for_depth_program;
-    depth_program_info.mvp_mat4 = depth_program->object_to_clip_mat4;
+    depth_program_info.object_block = true;
+    depth_program_info.instanced_program = depth_program_instanced->program;
+    depth_program_info.instanced_vao = *meshes_for_depth_program_instanced;
+    depth_program_info.instanced_light_to_clip_mat4 = depth_program_instanced->light_to_clip_mat4;
+    depth_program_info.multidraw_program = depth_program_multidraw->program;
+    depth_program_info.multidraw_vao = *meshes_for_depth_program_multidraw;
 
     for (uint32_t i = 0; i < asteroid_num; i++) {
         Scene::Transform *t = current_scene->new_transform();
@@ -240,11 +249,21 @@ GameMode::GameMode()
         obj->programs[Scene::Object::ProgramTypeShadow] = depth_program_info;
 
         MeshBuffer::Mesh const &mesh = meshes->lookup(stone_types[distribution_mesh(generator)]);
-        obj->programs[Scene::Object::ProgramTypeDefault].start = mesh.start;
-        obj->programs[Scene::Object::ProgramTypeDefault].count = mesh.count;
+        for (uint32_t type = 0; type < Scene::Object::ProgramTypes; ++type) {
+            obj->programs[type].start = mesh.start;
+            obj->programs[type].count = mesh.count;
+            obj->programs[type].index_type = meshes->index_type;
+            obj->programs[type].primitive = meshes->primitive;
+            obj->programs[type].base_vertex = mesh.base_vertex;
+            obj->programs[type].position_scale = mesh.position_scale;
+            obj->programs[type].position_offset = mesh.position_offset;
+            obj->programs[type].draw_slot = mesh.draw_slot;
+        }
 
-        obj->programs[Scene::Object::ProgramTypeShadow].start = mesh.start;
-        obj->programs[Scene::Object::ProgramTypeShadow].count = mesh.count;
+        obj->bounds_min = mesh.min;
+        obj->bounds_max = mesh.max;
+        obj->bounds_center = mesh.center;
+        obj->bounds_radius = mesh.radius;
 
         stones.emplace_back(obj, 0.0f, 0.0f, glm::vec3());
     }
@@ -269,17 +288,17 @@ void GameMode::reset_game()
     current_time = distribution_time(generator);
 //    current_time = 0.0f;
 
-    current_target_texture = *images[distribution_images(generator)];
+    current_target_layer = distribution_images(generator);
 
     for (auto &info : stones) {
-        info.stone->transform->scale = glm::vec3(0.03f, 0.03f, 0.03f);
-        info.stone->transform->position =
-            glm::vec3(distribution_x(generator), distribution_y(generator), distribution_z(generator));
+        info.stone->transform->set_scale(glm::vec3(0.03f, 0.03f, 0.03f));
+        info.stone->transform->set_position(
+            glm::vec3(distribution_x(generator), distribution_y(generator), distribution_z(generator)));
         info.axis = glm::normalize(glm::vec3(distribution_axis(generator),
                                              distribution_axis(generator),
                                              distribution_axis(generator)));
         info.angle = distribution_angle(generator);
-        info.stone->transform->rotation = glm::angleAxis(info.angle, info.axis);
+        info.stone->transform->set_rotation(glm::angleAxis(info.angle, info.axis));
         info.velocity = distribution_velocity(generator);
     }
 }
@@ -299,6 +318,12 @@ bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
         }
     }
 
+    if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F3) {
+        show_draw_stats = !show_draw_stats;
+        draw_stats_elapsed = 1.0f; //(print on the next frame)
+        return true;
+    }
+
     if (evt.type == SDL_MOUSEMOTION) {
         if (evt.motion.state & SDL_BUTTON(SDL_BUTTON_LEFT)) {
             viewpoint_angle += 5.0f * evt.motion.xrel / float(window_size.x);
@@ -317,16 +342,18 @@ bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 
 void GameMode::update(float elapsed)
 {
+    draw_stats_elapsed += elapsed;
+
     if (*reset) {
         reset_game();
         *reset = false;
     }
 
-    camera_parent_transform->rotation = glm::angleAxis(viewpoint_angle, glm::vec3(0.0f, 0.0f, 1.0f));
-    spot_parent_transform->rotation = glm::angleAxis(spot_spin, glm::vec3(0.0f, 0.0f, 1.0f));
+    camera_parent_transform->set_rotation(glm::angleAxis(viewpoint_angle, glm::vec3(0.0f, 0.0f, 1.0f)));
+    spot_parent_transform->set_rotation(glm::angleAxis(spot_spin, glm::vec3(0.0f, 0.0f, 1.0f)));
 
     for (auto &info : stones) {
-        info.stone->transform->rotation = glm::angleAxis(current_time * info.velocity + info.angle, info.axis);
+        info.stone->transform->set_rotation(glm::angleAxis(current_time * info.velocity + info.angle, info.axis));
     }
 
     if (current_controls.snap) {
@@ -343,18 +370,17 @@ void GameMode::update(float elapsed)
 
 //GameMode will render to some offscreen framebuffer(s).
 //This code allocates and resizes them as needed:
+// (both are depth-only: no color attachment, and draw/read buffers set to GL_NONE)
 struct Framebuffers
 {
     glm::uvec2 size = glm::uvec2(0, 0); //remember the size of the framebuffer
 
-    //This framebuffer is used for fullscreen effects:
-    GLuint color_tex = 0;
+    //This framebuffer is used for the target viewpoint's depth map:
     GLuint depth_tex = 0;
     GLuint fb = 0;
 
     //This framebuffer is used for shadow maps:
     glm::uvec2 shadow_size = glm::uvec2(0, 0);
-    GLuint shadow_color_tex = 0; //DEBUG
     GLuint shadow_depth_tex = 0;
     GLuint shadow_fb = 0;
 
@@ -364,15 +390,6 @@ struct Framebuffers
         if (size != new_size) {
             size = new_size;
 
-            if (color_tex == 0) glGenTextures(1, &color_tex);
-            glBindTexture(GL_TEXTURE_2D, color_tex);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x, size.y, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glBindTexture(GL_TEXTURE_2D, 0);
-
             if (depth_tex == 0) glGenTextures(1, &depth_tex);
             glBindTexture(GL_TEXTURE_2D, depth_tex);
             glTexImage2D(GL_TEXTURE_2D,
@@ -392,8 +409,9 @@ struct Framebuffers
 
             if (fb == 0) glGenFramebuffers(1, &fb);
             glBindFramebuffer(GL_FRAMEBUFFER, fb);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_tex, 0);
             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_tex, 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
             check_fb();
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -404,16 +422,6 @@ struct Framebuffers
         if (shadow_size != new_shadow_size) {
             shadow_size = new_shadow_size;
 
-            if (shadow_color_tex == 0) glGenTextures(1, &shadow_color_tex);
-            glBindTexture(GL_TEXTURE_2D, shadow_color_tex);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, shadow_size.x, shadow_size.y, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glBindTexture(GL_TEXTURE_2D, 0);
-
-
             if (shadow_depth_tex == 0) glGenTextures(1, &shadow_depth_tex);
             glBindTexture(GL_TEXTURE_2D, shadow_depth_tex);
             glTexImage2D(GL_TEXTURE_2D,
@@ -433,8 +441,9 @@ struct Framebuffers
 
             if (shadow_fb == 0) glGenFramebuffers(1, &shadow_fb);
             glBindFramebuffer(GL_FRAMEBUFFER, shadow_fb);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, shadow_color_tex, 0);
             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadow_depth_tex, 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
             check_fb();
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -443,16 +452,36 @@ struct Framebuffers
     }
 } fbs;
 
+//one line of a pass's Scene::DrawStats, for the F3 report:
+static void print_draw_stats(char const *pass, Scene::DrawStats const &stats)
+{
+    std::cout << "  " << pass << ": " << stats.drawn << " drawn, " << stats.culled << " culled, "
+              << stats.draw_calls << " draw calls (" << stats.batched << " objects in multi-draws), "
+              << stats.state_changes << " state changes" << std::endl;
+}
+
 void GameMode::draw(glm::uvec2 const &drawable_size)
 {
     fbs.allocate(drawable_size, glm::uvec2(512, 512));
 
+    //compute all world matrices changed by update() in one pass:
+    current_scene->update_world_matrices();
+
+    camera->aspect = drawable_size.x / float(drawable_size.y);
+
+    //find visible objects for the spot shadow map and the main view in a single walk over the scene:
+    // (the target view depth map sees the stones at a different time, so it is collected on its own below)
+    shadow_view.world_to_clip = spot->make_projection() * spot->transform->make_world_to_local();
+    shadow_view.program_type = Scene::Object::ProgramTypeShadow;
+    main_view.world_to_clip = camera->make_projection() * camera->transform->make_world_to_local();
+    main_view.program_type = Scene::Object::ProgramTypeDefault;
+    scene->collect({&shadow_view, &main_view});
+
     //Draw scene to shadow map for spotlight:
     glBindFramebuffer(GL_FRAMEBUFFER, fbs.shadow_fb);
     glViewport(0, 0, fbs.shadow_size.x, fbs.shadow_size.y);
 
-    glClearColor(1.0f, 0.0f, 1.0f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClear(GL_DEPTH_BUFFER_BIT);
     glEnable(GL_DEPTH_TEST);
     glDisable(GL_BLEND);
 
@@ -460,7 +489,7 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
     glCullFace(GL_FRONT);
     glEnable(GL_CULL_FACE);
 
-    scene->draw(spot, Scene::Object::ProgramTypeShadow);
+    scene->draw(shadow_view);
 
     glDisable(GL_CULL_FACE);
 
@@ -476,10 +505,8 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
         //Draw scene to shadow map for target viewpoint:
         glBindFramebuffer(GL_FRAMEBUFFER, fbs.fb);
         glViewport(0, 0, drawable_size.x, drawable_size.y);
-        camera->aspect = drawable_size.x / float(drawable_size.y);
 
-        glClearColor(1.0f, 0.0f, 1.0f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClear(GL_DEPTH_BUFFER_BIT);
         glEnable(GL_DEPTH_TEST);
         glDisable(GL_BLEND);
 
@@ -488,18 +515,22 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
         glEnable(GL_CULL_FACE);
 
         // set camera to target viewpoint
-        camera_parent_transform->rotation = glm::angleAxis(target_viewpoint_angle, glm::vec3(0.0f, 0.0f, 1.0f));
+        camera_parent_transform->set_rotation(glm::angleAxis(target_viewpoint_angle, glm::vec3(0.0f, 0.0f, 1.0f)));
 
         // set stones to target time
         for (auto &info : stones) {
-            info.stone->transform->rotation = glm::angleAxis(target_time * info.velocity + info.angle, info.axis);
+            info.stone->transform->set_rotation(glm::angleAxis(target_time * info.velocity + info.angle, info.axis));
         }
+        current_scene->update_world_matrices();
 
-        scene->draw(camera, Scene::Object::ProgramTypeShadow);
+        target_view.world_to_clip = camera->make_projection() * camera->transform->make_world_to_local();
+        target_view.program_type = Scene::Object::ProgramTypeShadow;
+        scene->collect({&target_view});
+        scene->draw(target_view);
 
         // reset stones to current time
         for (auto &info : stones) {
-            info.stone->transform->rotation = glm::angleAxis(current_time * info.velocity + info.angle, info.axis);
+            info.stone->transform->set_rotation(glm::angleAxis(current_time * info.velocity + info.angle, info.axis));
         }
 
         target_camera_projection = camera->make_projection();
@@ -507,7 +538,8 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
         target_camera_to_world = camera->transform->make_local_to_world();
 
         // reset camera to current viewpoint
-        camera_parent_transform->rotation = glm::angleAxis(viewpoint_angle, glm::vec3(0.0f, 0.0f, 1.0f));
+        camera_parent_transform->set_rotation(glm::angleAxis(viewpoint_angle, glm::vec3(0.0f, 0.0f, 1.0f)));
+        current_scene->update_world_matrices();
 
         glDisable(GL_CULL_FACE);
 
@@ -517,7 +549,6 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
     }
 
     glViewport(0, 0, drawable_size.x, drawable_size.y);
-    camera->aspect = drawable_size.x / float(drawable_size.y);
 
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -529,92 +560,45 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     {
-        //set up light positions:
-        glUseProgram(texture_program->program);
+        //set up lights and projections shared by every lit program (uploaded once for the whole frame):
+        FrameUniforms::Data frame;
 
         //don't use distant directional light at all (color == 0):
-        glUniform3fv(texture_program->sun_color_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, 0.0f)));
-        glUniform3fv(texture_program->sun_direction_vec3,
-                     1,
-                     glm::value_ptr(glm::normalize(glm::vec3(0.0f, 0.0f, -1.0f))));
+        frame.sun_color = glm::vec3(0.0f, 0.0f, 0.0f);
+        frame.sun_direction = glm::normalize(glm::vec3(0.0f, 0.0f, -1.0f));
         //use hemisphere light for subtle ambient light:
-        glUniform3fv(texture_program->sky_color_vec3, 1, glm::value_ptr(glm::vec3(0.2f, 0.2f, 0.3f)));
-        glUniform3fv(texture_program->sky_direction_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, 1.0f)));
-
-        glm::mat4 world_to_spot =
-            //This matrix converts from the spotlight's clip space ([-1,1]^3) into depth map texture
-            // coordinates ([0,1]^2) and depth map Z values ([0,1]):
-            glm::mat4(
-                0.5f, 0.0f, 0.0f, 0.0f,
-                0.0f, 0.5f, 0.0f, 0.0f,
-                0.0f, 0.0f, 0.5f, 0.0f,
-                0.5f, 0.5f, 0.5f + 0.00001f /* <-- bias */, 1.0f
-            )
-                //this is the world-to-clip matrix used when rendering the shadow map:
-                * spot->make_projection() * spot->transform->make_world_to_local();
-
-        glUniformMatrix4fv(texture_program->light_to_spot_mat4, 1, GL_FALSE, glm::value_ptr(world_to_spot));
+        frame.sky_color = glm::vec3(0.2f, 0.2f, 0.3f);
+        frame.sky_direction = glm::vec3(0.0f, 0.0f, 1.0f);
 
-        glm::mat4 spot_to_world = spot->transform->make_local_to_world();
-        glUniform3fv(texture_program->spot_position_vec3, 1, glm::value_ptr(glm::vec3(spot_to_world[3])));
-        glUniform3fv(texture_program->spot_direction_vec3, 1, glm::value_ptr(-glm::vec3(spot_to_world[2])));
-        glUniform3fv(texture_program->spot_color_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
-
-        glm::vec2 spot_outer_inner = glm::vec2(std::cos(0.5f * spot->fov), std::cos(0.85f * 0.5f * spot->fov));
-        glUniform2fv(texture_program->spot_outer_inner_vec2, 1, glm::value_ptr(spot_outer_inner));
-    }
-
-    {
-        //set up light positions:
-        glUseProgram(shady_program->program);
+        //This matrix converts from clip space ([-1,1]^3) into depth map texture
+        // coordinates ([0,1]^2) and depth map Z values ([0,1]):
+        glm::mat4 clip_to_depth_map = glm::mat4(
+            0.5f, 0.0f, 0.0f, 0.0f,
+            0.0f, 0.5f, 0.0f, 0.0f,
+            0.0f, 0.0f, 0.5f, 0.0f,
+            0.5f, 0.5f, 0.5f + 0.00001f /* <-- bias */, 1.0f
+        );
 
-        //don't use distant directional light at all (color == 0):
-        glUniform3fv(shady_program->sun_color_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, 0.0f)));
-        glUniform3fv(shady_program->sun_direction_vec3,
-                     1,
-                     glm::value_ptr(glm::normalize(glm::vec3(0.0f, 0.0f, -1.0f))));
-        //use hemisphere light for subtle ambient light:
-        glUniform3fv(shady_program->sky_color_vec3, 1, glm::value_ptr(glm::vec3(0.2f, 0.2f, 0.3f)));
-        glUniform3fv(shady_program->sky_direction_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, 1.0f)));
-
-        glm::mat4 world_to_spot =
-            //This matrix converts from the spotlight's clip space ([-1,1]^3) into depth map texture
-            // coordinates ([0,1]^2) and depth map Z values ([0,1]):
-            glm::mat4(
-                0.5f, 0.0f, 0.0f, 0.0f,
-                0.0f, 0.5f, 0.0f, 0.0f,
-                0.0f, 0.0f, 0.5f, 0.0f,
-                0.5f, 0.5f, 0.5f + 0.00001f /* <-- bias */, 1.0f
-            )
-                //this is the world-to-clip matrix used when rendering the shadow map:
-                * spot->make_projection() * spot->transform->make_world_to_local();
-
-        glUniformMatrix4fv(shady_program->light_to_spot_mat4, 1, GL_FALSE, glm::value_ptr(world_to_spot));
+        //multiplied by the world-to-clip matrix used when rendering the shadow map:
+        frame.light_to_spot = clip_to_depth_map * spot->make_projection() * spot->transform->make_world_to_local();
 
         glm::mat4 spot_to_world = spot->transform->make_local_to_world();
-        glUniform3fv(shady_program->spot_position_vec3, 1, glm::value_ptr(glm::vec3(spot_to_world[3])));
-        glUniform3fv(shady_program->spot_direction_vec3, 1, glm::value_ptr(-glm::vec3(spot_to_world[2])));
-        glUniform3fv(shady_program->spot_color_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
+        frame.spot_position = glm::vec3(spot_to_world[3]);
+        frame.spot_direction = -glm::vec3(spot_to_world[2]);
+        frame.spot_color = glm::vec3(1.0f, 1.0f, 1.0f);
+        frame.spot_outer_inner = glm::vec2(std::cos(0.5f * spot->fov), std::cos(0.85f * 0.5f * spot->fov));
 
-        glm::vec2 spot_outer_inner = glm::vec2(std::cos(0.5f * spot->fov), std::cos(0.85f * 0.5f * spot->fov));
-        glUniform2fv(shady_program->spot_outer_inner_vec2, 1, glm::value_ptr(spot_outer_inner));
+        //...and by the world-to-clip matrix used when rendering the target view depth map:
+        frame.light_to_target = clip_to_depth_map * target_camera_projection * target_camera_world_to_local;
 
-        glm::mat4 world_to_target =
-            glm::mat4(
-                0.5f, 0.0f, 0.0f, 0.0f,
-                0.0f, 0.5f, 0.0f, 0.0f,
-                0.0f, 0.0f, 0.5f, 0.0f,
-                0.5f, 0.5f, 0.5f + 0.00001f /* <-- bias */, 1.0f
-            )
-                //this is the world-to-clip matrix used when rendering the shadow map:
-                * target_camera_projection * target_camera_world_to_local;
+        frame.target_position = glm::vec3(target_camera_to_world[3]);
+        frame.target_direction = -glm::vec3(target_camera_to_world[2]);
 
-        glUniformMatrix4fv(shady_program->light_to_target_mat4, 1, GL_FALSE, glm::value_ptr(world_to_target));
+        frame.screen_size = glm::vec2(drawable_size.x, drawable_size.y);
 
-        glUniform3fv(shady_program->target_position_vec3, 1, glm::value_ptr(glm::vec3(target_camera_to_world[3])));
-        glUniform3fv(shady_program->target_direction_vec3, 1, glm::value_ptr(-glm::vec3(target_camera_to_world[2])));
+        frame.gateway_layer = float(current_target_layer);
 
-        glUniform2fv(shady_program->screen_size_vec2, 1, glm::value_ptr(glm::vec2(drawable_size.x, drawable_size.y)));
+        frame_uniforms->upload(frame);
     }
 
 
@@ -636,31 +620,40 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LESS);
 
-    // binding the gateway texture to index 3
+    // binding the gateway images to index 3 (the current one is picked by frame.gateway_layer)
     glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, current_target_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, *gateway_images_tex);
 
     glActiveTexture(GL_TEXTURE0);
 
-    scene->draw(camera);
+    scene->draw(main_view);
 
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, 0);
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, 0);
     glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
     glActiveTexture(GL_TEXTURE0);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     GL_ERRORS();
+
+    if (show_draw_stats && draw_stats_elapsed >= 1.0f) {
+        std::cout << "Draw stats:" << std::endl;
+        print_draw_stats("shadow", shadow_view.stats);
+        print_draw_stats("target", target_view.stats);
+        print_draw_stats("main", main_view.stats);
+        draw_stats_elapsed = 0.0f;
+    }
 }
 
 void GameMode::show_transition()
 {
-    std::shared_ptr<TransitionMode> transition = std::make_shared<TransitionMode>(current_target_texture, reset);
+    std::shared_ptr<TransitionMode> transition
+        = std::make_shared<TransitionMode>(*gateway_images_tex, current_target_layer, reset);
 
     std::shared_ptr<Mode> game = shared_from_this();
     transition->background = game;
@@ -60,7 +60,7 @@ struct GameMode: public Mode
     float target_time;
     float target_viewpoint_angle;
     static const uint32_t asteroid_num = 60;
-    GLuint current_target_texture;
+    uint32_t current_target_layer = 0; //layer of gateway_images_tex shown through the gateway
     Scene::Camera *target_camera = nullptr;
     std::shared_ptr<bool> reset;
     std::default_random_engine generator;
@@ -69,4 +69,12 @@ struct GameMode: public Mode
     std::uniform_int_distribution<uint32_t> distribution_mesh, distribution_images;
     std::vector<StoneInfo> stones;
 
+    //passes of draw() (spot shadow map, target view depth, main view); each keeps its visible list and
+    // the objects drawn / culled by the last frame in its 'stats':
+    Scene::View shadow_view, target_view, main_view;
+
+    //F3 toggles printing those stats to the console, about once a second:
+    bool show_draw_stats = false;
+    float draw_stats_elapsed = 0.0f; //time since they were last printed
+
 };
@@ -2,31 +2,198 @@
 
 #include <array>
 #include <list>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <algorithm>
 #include <cassert>
+#include <iostream>
 
 namespace
 {
-std::array<std::list<std::function<void()> >, LoadTagCount> &get_load_lists()
+struct LoadEntry
 {
-    static std::array<std::list<std::function<void()> >, LoadTagCount> load_lists;
+    std::function<void()> fn; //either a function to call...
+    DecodeFunction decode_fn; //...or one to run on a worker thread
+    std::future<UploadFunction> decoded;
+    float decode_seconds = 0.0f; //time decode_fn took (on its worker thread)
+};
+
+std::array<std::list<LoadEntry>, LoadTagCount> &get_load_lists()
+{
+    static std::array<std::list<LoadEntry>, LoadTagCount> load_lists;
     return load_lists;
 }
+
+//threads that run decode functions:
+struct Workers
+{
+    ~Workers()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::future<UploadFunction> run(DecodeFunction const &decode_fn)
+    {
+        std::packaged_task<UploadFunction()> task(decode_fn);
+        std::future<UploadFunction> ret = task.get_future();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (threads.empty()) {
+                //leave a core for the main thread, which keeps loading (or drawing) meanwhile:
+                uint32_t count = std::max(2U, std::thread::hardware_concurrency()) - 1;
+                for (uint32_t i = 0; i < count; ++i) {
+                    threads.emplace_back([this]() { work(); });
+                }
+            }
+            tasks.emplace_back(std::move(task));
+        }
+        wake.notify_one();
+        return ret;
+    }
+
+    size_t size()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return threads.size();
+    }
+
+    void work()
+    {
+        while (true) {
+            std::packaged_task<UploadFunction()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return quit || !tasks.empty(); });
+                if (quit) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task(); //(exceptions are stored in the future)
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::packaged_task<UploadFunction()> > tasks;
+    std::vector<std::thread> threads;
+    bool quit = false;
+};
+
+Workers &get_workers()
+{
+    static Workers workers;
+    return workers;
+}
+
+std::list<std::future<UploadFunction> > &get_background_loads()
+{
+    static std::list<std::future<UploadFunction> > background_loads;
+    return background_loads;
+}
 }
 
 void add_load_function(LoadTag tag, std::function<void()> const &fn)
 {
     auto &load_lists = get_load_lists();
     assert(tag < load_lists.size());
-    load_lists[tag].emplace_back(fn);
+    load_lists[tag].emplace_back();
+    load_lists[tag].back().fn = fn;
+}
+
+void add_background_load_function(LoadTag tag, DecodeFunction const &decode_fn)
+{
+    auto &load_lists = get_load_lists();
+    assert(tag < load_lists.size());
+    load_lists[tag].emplace_back();
+    load_lists[tag].back().decode_fn = decode_fn;
 }
 
 void call_load_functions()
 {
     auto &load_lists = get_load_lists();
+    typedef std::chrono::steady_clock Clock;
+    auto seconds_since = [](Clock::time_point const &start) {
+        return std::chrono::duration<float>(Clock::now() - start).count();
+    };
+    Clock::time_point load_start = Clock::now();
+
+    //start every decode function right away (they don't depend on other loads):
+    uint32_t decodes = 0;
+    for (auto &fn_list : load_lists) {
+        for (auto &entry : fn_list) {
+            if (!entry.decode_fn) continue;
+            LoadEntry *e = &entry; //(list entries don't move, and the future is waited on before the entry is removed)
+            entry.decoded = get_workers().run([e, seconds_since]() {
+                Clock::time_point start = Clock::now();
+                UploadFunction upload = e->decode_fn();
+                e->decode_seconds = seconds_since(start);
+                return upload;
+            });
+            ++decodes;
+        }
+    }
+
+    //call functions in tag order, waiting for decode functions to finish as their turn comes up:
+    uint32_t loads = 0;
+    float decode_seconds = 0.0f; //total over all workers
+    float main_seconds = 0.0f; //spent on this thread (not counting waits)
     for (auto &fn_list : load_lists) {
         while (!fn_list.empty()) {
-            (*fn_list.begin())(); //call first function in the list
+            LoadEntry &entry = *fn_list.begin();
+            if (entry.decode_fn) {
+                UploadFunction upload = entry.decoded.get(); //(rethrows anything thrown by decode_fn)
+                decode_seconds += entry.decode_seconds;
+                Clock::time_point start = Clock::now();
+                upload();
+                main_seconds += seconds_since(start);
+            }
+            else {
+                Clock::time_point start = Clock::now();
+                entry.fn(); //call first function in the list
+                main_seconds += seconds_since(start);
+            }
             fn_list.pop_front(); //remove from list
+            ++loads;
+        }
+    }
+
+    //compare with doing the same work one load after another:
+    if (decodes > 0) {
+        std::cout << "Loaded " << loads << " resources in " << 1000.0f * seconds_since(load_start) << " ms ("
+                  << decodes << " decoded on " << get_workers().size() << " worker threads); serially this would take "
+                  << 1000.0f * (decode_seconds + main_seconds) << " ms (" << 1000.0f * decode_seconds << " ms decoding + "
+                  << 1000.0f * main_seconds << " ms on the main thread)." << std::endl;
+    }
+}
+
+void load_in_background(DecodeFunction const &decode_fn)
+{
+    get_background_loads().emplace_back(get_workers().run(decode_fn));
+}
+
+void update_background_loads()
+{
+    auto &background_loads = get_background_loads();
+    for (auto l = background_loads.begin(); l != background_loads.end(); /* later */) {
+        if (l->wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            UploadFunction upload = l->get();
+            l = background_loads.erase(l);
+            upload();
+        }
+        else {
+            ++l;
         }
     }
 }
@@ -21,10 +21,22 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. "Meshes"] before looking up individual elements within them.)
  *
+ * Loads that spend most of their time reading and decoding files can be split in two:
+ *
+ * Load< MeshBuffer > meshes(LoadTagDefault, []() {
+ *     MeshBuffer *ret = new MeshBuffer(data_path("meshes.pnct")); //runs on a worker thread
+ *     return [ret]() { ret->upload(); return ret; }; //runs on the main thread, in tag order
+ * });
+ *
+ * The first function must not make OpenGL calls or use other Load<> values.
+ * call_load_functions() starts all such functions on worker threads before calling anything else,
+ * so file reads and decoding overlap with each other and with the loads that do need the GL context.
+ *
  */
 
 #include <functional>
 #include <stdexcept>
+#include <cstdint>
 
 enum LoadTag: uint32_t
 {
@@ -34,9 +46,18 @@ enum LoadTag: uint32_t
     LoadTagCount = 3
 };
 
+typedef std::function<void()> UploadFunction; //finishes a load on the main thread
+typedef std::function<UploadFunction()> DecodeFunction; //does the rest of a load on a worker thread
+
 void add_load_function(LoadTag tag, std::function<void()> const &fn);
+void add_background_load_function(LoadTag tag, DecodeFunction const &decode_fn);
 void call_load_functions(); //called by main() after GL context created.
 
+//Load something while the game keeps running (e.g. the next level):
+// decode_fn runs on a worker thread; the function it returns is called by a later update_background_loads():
+void load_in_background(DecodeFunction const &decode_fn);
+void update_background_loads(); //called by main() once per frame.
+
 template<typename T>
 struct Load
 {
@@ -53,6 +74,23 @@ struct Load
       });
     }
 
+    //...or pass a function to run on a worker thread, which returns the function to run on the main thread:
+    Load(LoadTag tag, const std::function<std::function<T const *()>()> &decode_fn)
+        : value(nullptr)
+    {
+      add_background_load_function(tag, [this, decode_fn]() -> UploadFunction
+      {
+          std::function<T const *()> upload_fn = decode_fn();
+          return [this, upload_fn]()
+          {
+              this->value = upload_fn();
+              if (!(this->value)) {
+                throw std::runtime_error("Loading failed.");
+              }
+          };
+      });
+    }
+
     //Make a "Load< T >" behave like a "T const *":
     explicit operator bool()
     { return value != nullptr; }
@@ -143,5 +143,7 @@ void MenuMode::draw(glm::uvec2 const &drawable_size)
         y -= choice.padding;
     }
 
+    flush_text(drawable_size);
+
     glEnable(GL_DEPTH_TEST);
 }
@@ -1,218 +1,520 @@
 #include "MeshBuffer.hpp"
-#include "read_chunk.hpp"
+#include "mapped_file.hpp"
+#include "optimize_mesh.hpp"
+#include "compile_program.hpp"
+#include "geometry_arena.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
-#include <set>
 #include <cstddef>
-
-MeshBuffer::MeshBuffer(std::string const &filename)
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cstdlib>
+
+//------------ vertex formats ------------
+//Every vertex format that export-meshes.py writes is a list of these attributes, stored packed in list order.
+// (the file extension and chunk magic are made from the attributes' letters)
+
+template<char Letter, typename Storage_, GLint Size, GLenum Type, GLboolean Normalized, MeshBuffer::Attrib MeshBuffer::*Member>
+struct VertexAttribute
 {
-  glGenBuffers(1, &vbo);
-
-  std::ifstream file(filename, std::ios::binary);
-
-  GLuint total = 0;
-  //read + upload data chunk:
-  if (filename.size() >= 2 && filename.substr(filename.size() - 2) == ".p") {
-    struct Vertex
-    {
-        glm::vec3 Position;
-    };
-    static_assert(sizeof(Vertex) == 3 * 4, "Vertex is packed.");
+    typedef Storage_ Storage;
+    static constexpr char letter = Letter;
+
+    static void set(MeshBuffer *buffer, GLsizei stride, GLsizei offset)
+    { buffer->*Member = MeshBuffer::Attrib(Size, Type, Normalized, stride, offset); }
+};
+
+typedef VertexAttribute<'p', glm::vec3, 3, GL_FLOAT, GL_FALSE, &MeshBuffer::Position> PositionF;
+typedef VertexAttribute<'n', glm::vec3, 3, GL_FLOAT, GL_FALSE, &MeshBuffer::Normal> NormalF;
+typedef VertexAttribute<'c', glm::u8vec4, 4, GL_UNSIGNED_BYTE, GL_TRUE, &MeshBuffer::Color> ColorU8;
+typedef VertexAttribute<'t', glm::vec2, 2, GL_FLOAT, GL_FALSE, &MeshBuffer::TexCoord> TexCoordF;
+
+//quantized attributes ('q' file types):
+typedef uint16_t UShort4[4];
+typedef uint16_t UShort2[2];
+typedef VertexAttribute<'p', UShort4, 3, GL_UNSIGNED_SHORT, GL_TRUE, &MeshBuffer::Position> PositionQ; //(x,y,z,unused) as fraction of mesh box
+typedef VertexAttribute<'n', uint32_t, 4, GL_INT_2_10_10_10_REV, GL_TRUE, &MeshBuffer::Normal> NormalQ; //signed 10:10:10:2
+typedef VertexAttribute<'t', UShort2, 2, GL_HALF_FLOAT, GL_FALSE, &MeshBuffer::TexCoord> TexCoordQ; //half float
+
+//packed struct with one member per attribute:
+template<typename First, typename... Rest>
+struct PackedVertex
+{
+    typename First::Storage first;
+    PackedVertex<Rest...> rest;
+};
 
-    std::vector<Vertex> data;
-    read_chunk(file, "p...", &data);
+template<typename Last>
+struct PackedVertex<Last>
+{
+    typename Last::Storage first;
+};
 
-    //upload data:
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+constexpr size_t sum(std::initializer_list<size_t> sizes)
+{
+  size_t total = 0;
+  for (size_t size : sizes) total += size;
+  return total;
+}
 
-    total = GLuint(data.size()); //store total for later checks on index
+template<char Prefix, typename... Attributes>
+struct VertexFormat
+{
+    typedef PackedVertex<Attributes...> Vertex;
+    static_assert(sizeof(Vertex) == sum({sizeof(typename Attributes::Storage)...}), "Vertex is packed.");
+    static constexpr GLsizei stride = sizeof(Vertex);
+
+    //e.g. "pnct" (or "qpnct" for quantized formats):
+    static std::string letters()
+    { return (Prefix ? std::string(1, Prefix) : std::string()) + std::string({Attributes::letter...}); }
+    static std::string extension()
+    { return "." + letters(); }
+    static std::string magic()
+    { return (letters() + "...").substr(0, 4); }
 
     //store attrib locations:
-    Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-
-  }
-  else if (filename.size() >= 3 && filename.substr(filename.size() - 3) == ".pn") {
-    struct Vertex
+    static void set_attribs(MeshBuffer *buffer)
     {
-        glm::vec3 Position;
-        glm::vec3 Normal;
-    };
-    static_assert(sizeof(Vertex) == 3 * 4 + 3 * 4, "Vertex is packed.");
-
-    std::vector<Vertex> data;
-    read_chunk(file, "pn..", &data);
+      GLsizei offset = 0;
+      int expand[] = {0, (Attributes::set(buffer, stride, offset), offset += sizeof(typename Attributes::Storage), 0)...};
+      (void) expand;
+      assert(offset == stride);
+    }
+};
+
+//(Position must be first; bounding volume computation relies on it)
+typedef VertexFormat<0, PositionF> P;
+typedef VertexFormat<0, PositionF, NormalF> PN;
+typedef VertexFormat<0, PositionF, ColorU8> PC;
+typedef VertexFormat<0, PositionF, TexCoordF> PT;
+typedef VertexFormat<0, PositionF, NormalF, ColorU8> PNC;
+typedef VertexFormat<0, PositionF, ColorU8, TexCoordF> PCT;
+typedef VertexFormat<0, PositionF, NormalF, TexCoordF> PNT;
+typedef VertexFormat<0, PositionF, NormalF, ColorU8, TexCoordF> PNCT;
+typedef VertexFormat<'q', PositionQ, NormalQ, ColorU8, TexCoordQ> QPNCT;
+
+//if filename ends with the format's extension (and no format was found yet), read the vertex chunk and set attribs:
+template<typename Format>
+static bool read_vertices(std::string const &filename, ChunkReader &file, ChunkView<uint8_t> *vertex_chunk,
+                          GLsizei *stride, bool *found, MeshBuffer *buffer,
+                          std::string const &extension = Format::extension())
+{
+  if (*found) return false;
+  if (!(filename.size() >= extension.size() && filename.substr(filename.size() - extension.size()) == extension)) {
+    return false;
+  }
+  read_chunk(file, Format::magic(), vertex_chunk);
+  *stride = Format::stride;
+  Format::set_attribs(buffer);
+  *found = true;
+  return true;
+}
 
-    //upload data:
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+//------------ MeshBuffer ------------
 
-    total = GLuint(data.size()); //store total for later checks on index
+MeshBuffer::MeshBuffer(std::string const &filename, VertexStreams streams)
+{
+  //chunks are viewed directly in the mapped file; only data that gets modified is copied out:
+  MappedFile mapped(filename);
+  ChunkReader file(mapped);
 
-    //store attrib locations:
-    Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-    Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
+  //vertex data is read as bytes; each file type says how to interpret them:
+  // (Position is always the first member, which bounding volume computation relies on)
+  ChunkView<uint8_t> vertex_chunk;
+  GLsizei stride = 0;
 
+  //quantized file types store positions as 16-bit fractions of each mesh's bounding box:
+  struct Quantization
+  {
+      glm::vec3 scale;
+      glm::vec3 offset;
+  };
+  static_assert(sizeof(Quantization) == 6 * 4, "Quantization is packed.");
+  ChunkView<Quantization> quantization;
+  bool quantized = false;
+
+  //find the vertex format named by the file's extension and read its vertex chunk:
+  bool found = false;
+  read_vertices<P>(filename, file, &vertex_chunk, &stride, &found, this);
+  if (read_vertices<P>(filename, file, &vertex_chunk, &stride, &found, this, ".pl")) primitive = GL_LINES;
+  read_vertices<PN>(filename, file, &vertex_chunk, &stride, &found, this);
+  read_vertices<PC>(filename, file, &vertex_chunk, &stride, &found, this);
+  read_vertices<PT>(filename, file, &vertex_chunk, &stride, &found, this);
+  read_vertices<PNC>(filename, file, &vertex_chunk, &stride, &found, this);
+  read_vertices<PCT>(filename, file, &vertex_chunk, &stride, &found, this);
+  read_vertices<PNT>(filename, file, &vertex_chunk, &stride, &found, this);
+  read_vertices<PNCT>(filename, file, &vertex_chunk, &stride, &found, this);
+  if (read_vertices<QPNCT>(filename, file, &vertex_chunk, &stride, &found, this)) {
+    read_chunk(file, "qnt0", &quantization);
+    quantized = true;
+  }
+  if (!found) {
+    throw std::runtime_error("Unknown file type '" + filename + "'");
   }
-  else if (filename.size() >= 4 && filename.substr(filename.size() - 4) == ".pnc") {
-    struct Vertex
-    {
-        glm::vec3 Position;
-        glm::vec3 Normal;
-        glm::u8vec4 Color;
-    };
-    static_assert(sizeof(Vertex) == 3 * 4 + 3 * 4 + 4 * 1, "Vertex is packed.");
 
-    std::vector<Vertex> data;
-    read_chunk(file, "pnc.", &data);
+  if (vertex_chunk.size() % stride != 0) {
+    throw std::runtime_error("Size of vertex chunk not divisible by vertex size");
+  }
+  GLuint total = GLuint(vertex_chunk.size() / stride); //store total for later checks on index
+
+  //indexed files follow vertex data with an element chunk:
+  std::vector<uint32_t> elements;
+  std::string element_magic = peek_chunk_magic(file);
+  if (element_magic == "e16.") {
+    ChunkView<uint16_t> elements16;
+    read_chunk(file, "e16.", &elements16);
+    elements.assign(elements16.begin(), elements16.end());
+  }
+  else if (element_magic == "e32.") {
+    ChunkView<uint32_t> elements32;
+    read_chunk(file, "e32.", &elements32);
+    elements.assign(elements32.begin(), elements32.end());
+  }
 
-    //upload data:
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  ChunkView<char> strings;
+  read_chunk(file, "str0", &strings);
 
-    total = GLuint(data.size()); //store total for later checks on index
+  //each mesh is a range of vertices and a range of elements (relative to the first vertex of the mesh):
+  struct IndexEntry
+  {
+      uint32_t name_begin, name_end;
+      uint32_t vertex_begin, vertex_end;
+      uint32_t element_begin, element_end;
+  };
+  static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
+  std::vector<IndexEntry> index;
 
-    //store attrib locations:
-    Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-    Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-    Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+  //vertex data in its final order (optimization below reorders it in place):
+  std::vector<uint8_t> vertices;
 
+  if (element_magic == "e16." || element_magic == "e32.") {
+    ChunkView<IndexEntry> index_chunk;
+    read_chunk(file, "idx1", &index_chunk);
+    index.assign(index_chunk.begin(), index_chunk.end());
+    vertices.assign(vertex_chunk.begin(), vertex_chunk.end());
+    for (auto const &entry : index) {
+      if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+        throw std::runtime_error("index entry has out-of-range vertex start/count");
+      }
+      if (!(entry.element_begin <= entry.element_end && entry.element_end <= elements.size())) {
+        throw std::runtime_error("index entry has out-of-range element start/count");
+      }
+      for (uint32_t e = entry.element_begin; e < entry.element_end; ++e) {
+        if (elements[e] >= entry.vertex_end - entry.vertex_begin) {
+          throw std::runtime_error("element refers to vertex outside of its mesh");
+        }
+      }
+    }
   }
-  else if (filename.size() >= 5 && filename.substr(filename.size() - 5) == ".pnct") {
-    struct Vertex
+  else {
+    //triangle soup (older files) -- index it here, merging identical vertices within each mesh:
+    struct SoupEntry
     {
-        glm::vec3 Position;
-        glm::vec3 Normal;
-        glm::u8vec4 Color;
-        glm::vec2 TexCoord;
+        uint32_t name_begin, name_end;
+        uint32_t vertex_begin, vertex_end;
+    };
+    static_assert(sizeof(SoupEntry) == 16, "Index entry should be packed");
+
+    ChunkView<SoupEntry> soup;
+    read_chunk(file, "idx0", &soup);
+
+    //vertices are keyed by their index in the chunk, and hashed and compared by their 'stride' bytes:
+    uint8_t const *soup_vertices = vertex_chunk.data();
+    auto vertex_hash = [soup_vertices, stride](uint32_t v) {
+      //(FNV-1a)
+      size_t hash = size_t(0xcbf29ce484222325ULL);
+      for (uint8_t const *b = soup_vertices + size_t(v) * stride, *end = b + stride; b != end; ++b) {
+        hash = (hash ^ *b) * size_t(0x100000001b3ULL);
+      }
+      return hash;
+    };
+    auto vertex_equal = [soup_vertices, stride](uint32_t a, uint32_t b) {
+      return memcmp(soup_vertices + size_t(a) * stride, soup_vertices + size_t(b) * stride, stride) == 0;
     };
-    static_assert(sizeof(Vertex) == 3 * 4 + 3 * 4 + 4 * 1 + 2 * 4, "Vertex is packed.");
 
-    std::vector<Vertex> data;
-    read_chunk(file, "pnct", &data);
+    vertices.reserve(vertex_chunk.size());
+    for (auto const &entry : soup) {
+      if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+        throw std::runtime_error("index entry has out-of-range vertex start/count");
+      }
+      IndexEntry indexed;
+      indexed.name_begin = entry.name_begin;
+      indexed.name_end = entry.name_end;
+      indexed.vertex_begin = GLuint(vertices.size() / stride);
+      indexed.element_begin = GLuint(elements.size());
+
+      std::unordered_map<uint32_t, uint32_t, decltype(vertex_hash), decltype(vertex_equal)>
+          seen(entry.vertex_end - entry.vertex_begin, vertex_hash, vertex_equal);
+      for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+        auto inserted = seen.insert(std::make_pair(v, uint32_t(seen.size())));
+        if (inserted.second) {
+          vertices.insert(vertices.end(), soup_vertices + size_t(v) * stride, soup_vertices + size_t(v + 1) * stride);
+        }
+        elements.emplace_back(inserted.first->second);
+      }
 
-    //upload data:
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+      indexed.vertex_end = GLuint(vertices.size() / stride);
+      indexed.element_end = GLuint(elements.size());
+      index.emplace_back(indexed);
+    }
+    total = GLuint(vertices.size() / stride);
+  }
 
-    total = GLuint(data.size()); //store total for later checks on index
+  //reorder each mesh's triangles for the post-transform vertex cache, then its vertices into fetch order:
+  // (lines are left in file order)
+  uint32_t misses_before = 0, misses_after = 0, triangles = 0;
+  for (auto const &entry : index) {
+    uint32_t *mesh_elements = elements.data() + entry.element_begin;
+    uint32_t element_count = entry.element_end - entry.element_begin;
+    uint32_t vertex_count = entry.vertex_end - entry.vertex_begin;
+    if (primitive == GL_LINES) {
+      if (element_count % 2 != 0) {
+        throw std::runtime_error("index entry has element count not divisible by 2");
+      }
+      continue;
+    }
+    if (element_count % 3 != 0) {
+      throw std::runtime_error("index entry has element count not divisible by 3");
+    }
+    misses_before += count_vertex_cache_misses(mesh_elements, element_count, vertex_count);
+    optimize_vertex_cache(mesh_elements, element_count, vertex_count);
+    optimize_vertex_fetch(mesh_elements, element_count, vertices.data() + entry.vertex_begin * stride, vertex_count, stride);
+    misses_after += count_vertex_cache_misses(mesh_elements, element_count, vertex_count);
+    triangles += element_count / 3;
+  }
+  //(kept for upload() to print, since this may be running on a worker thread)
+  if (triangles != 0) {
+    vertex_cache_report = "Mesh file '" + filename + "': " + std::to_string(triangles) + " triangles, vertex cache ACMR "
+                        + std::to_string(float(misses_before) / triangles) + " -> "
+                        + std::to_string(float(misses_after) / triangles);
+  }
 
-    //store attrib locations:
-    Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-    Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-    Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-    TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+  //use 16-bit elements if every mesh is small enough:
+  index_type = GL_UNSIGNED_SHORT;
+  for (auto const &entry : index) {
+    if (entry.vertex_end - entry.vertex_begin > 0x10000) index_type = GL_UNSIGNED_INT;
+  }
 
+  //stage element data in its final format:
+  if (index_type == GL_UNSIGNED_SHORT) {
+    staged_elements.resize(elements.size() * 2);
+    for (size_t e = 0; e < elements.size(); ++e) {
+      uint16_t element = uint16_t(elements[e]);
+      memcpy(&staged_elements[e * 2], &element, 2);
+    }
   }
   else {
-    throw std::runtime_error("Unknown file type '" + filename + "'");
+    staged_elements.resize(elements.size() * 4);
+    memcpy(staged_elements.data(), elements.data(), staged_elements.size());
   }
 
-  std::vector<char> strings;
-  read_chunk(file, "str0", &strings);
+  if (quantized && quantization.size() != index.size()) {
+    throw std::runtime_error("Quantization chunk doesn't match index chunk");
+  }
 
-  { //read index chunk, add to meshes:
-    struct IndexEntry
-    {
-        uint32_t name_begin, name_end;
-        uint32_t vertex_begin, vertex_end;
-    };
-    static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+  //keep (object space) positions for computing bounding volumes:
+  std::vector<glm::vec3> positions(total);
+  if (quantized) {
+    for (uint32_t i = 0; i < index.size(); ++i) {
+      for (GLuint v = index[i].vertex_begin; v < index[i].vertex_end; ++v) {
+        uint16_t q[3];
+        memcpy(q, &vertices[v * stride], sizeof(q));
+        positions[v] = quantization[i].offset + quantization[i].scale * (glm::vec3(q[0], q[1], q[2]) / 65535.0f);
+      }
+    }
+  }
+  else {
+    for (GLuint v = 0; v < total; ++v) {
+      memcpy(&positions[v], &vertices[v * stride], sizeof(glm::vec3));
+    }
+  }
 
-    std::vector<IndexEntry> index;
-    read_chunk(file, "idx0", &index);
+  //add to meshes:
+  for (uint32_t i = 0; i < index.size(); ++i) {
+    IndexEntry const &entry = index[i];
+    if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+      throw std::runtime_error("index entry has out-of-range name begin/end");
+    }
+    std::string name(strings.data() + entry.name_begin, strings.data() + entry.name_end);
+    Mesh mesh;
+    mesh.start = entry.element_begin;
+    mesh.count = entry.element_end - entry.element_begin;
+    mesh.base_vertex = GLint(entry.vertex_begin);
+    mesh.vertex_count = entry.vertex_end - entry.vertex_begin;
+    if (quantized) {
+      mesh.position_scale = quantization[i].scale;
+      mesh.position_offset = quantization[i].offset;
+    }
+    compute_bounds(positions.data() + mesh.base_vertex, mesh.vertex_count, &mesh);
+    bool inserted = ids.insert(std::make_pair(name, MeshId(meshes.size()))).second;
+    if (inserted) {
+      meshes.emplace_back(mesh);
+    }
+    else {
+      std::cerr
+          << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh."
+          << std::endl;
+    }
+  }
 
-    for (auto const &entry : index) {
-      if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
-        throw std::runtime_error("index entry has out-of-range name begin/end");
-      }
-      if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
-        throw std::runtime_error("index entry has out-of-range vertex start/count");
-      }
-      std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
-      Mesh mesh;
-      mesh.start = entry.vertex_begin;
-      mesh.count = entry.vertex_end - entry.vertex_begin;
-      bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-      if (!inserted) {
-        std::cerr
-            << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh."
-            << std::endl;
-      }
+  //move positions to their own tightly packed stream, if asked (and if there is anything else to separate them from):
+  // (Position is the first member of every format, so everything else moves down by its size)
+  GLsizei position_bytes = stride;
+  for (Attrib const *attrib : {&Normal, &Color, &TexCoord}) {
+    if (attrib->size != 0) position_bytes = std::min(position_bytes, attrib->offset);
+  }
+  if (streams == SeparatePositions && position_bytes < stride) {
+    std::vector<uint8_t> rest(size_t(total) * (stride - position_bytes));
+    staged_positions.resize(size_t(total) * position_bytes);
+    for (GLuint v = 0; v < total; ++v) {
+      memcpy(&staged_positions[v * position_bytes], &vertices[v * stride], position_bytes);
+      memcpy(&rest[v * (stride - position_bytes)], &vertices[v * stride + position_bytes], stride - position_bytes);
     }
+    vertices.swap(rest);
+
+    Position.stride = position_bytes;
+    for (Attrib *attrib : {&Normal, &Color, &TexCoord}) {
+      if (attrib->size == 0) continue;
+      attrib->stride = stride - position_bytes;
+      attrib->offset -= position_bytes;
+    }
+    position_stride = position_bytes;
+    vertex_stride = stride - position_bytes;
+  }
+  else {
+    vertex_stride = stride;
   }
 
-  if (file.peek() != EOF) {
+  staged_vertices.swap(vertices);
+
+  if (!file.at_end()) {
     std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
   }
 
   /* //DEBUG:
   std::cout << "File '" << filename << "' contained meshes";
-  for (auto const &m : meshes) {
-      if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
+  for (auto const &m : ids) {
+      if (&m.second == &ids.rbegin()->second && ids.size() > 1) std::cout << " and";
       std::cout << " '" << m.first << "'";
-      if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+      if (&m.second != &ids.rbegin()->second) std::cout << ",";
   }
   std::cout << std::endl;
   */
 }
 
-const MeshBuffer::Mesh &MeshBuffer::lookup(std::string const &name) const
+void MeshBuffer::compute_bounds(glm::vec3 const *positions, GLuint count, Mesh *mesh_)
+{
+  assert(mesh_);
+  auto &mesh = *mesh_;
+  if (count == 0) {
+    mesh.min = mesh.max = mesh.center = glm::vec3(0.0f);
+    mesh.radius = 0.0f;
+    return;
+  }
+
+  mesh.min = mesh.max = positions[0];
+  for (GLuint i = 1; i < count; ++i) {
+    mesh.min = glm::min(mesh.min, positions[i]);
+    mesh.max = glm::max(mesh.max, positions[i]);
+  }
+
+  //sphere around the box center (usually much tighter than the box's half-diagonal):
+  mesh.center = 0.5f * (mesh.min + mesh.max);
+  float radius2 = 0.0f;
+  for (GLuint i = 0; i < count; ++i) {
+    glm::vec3 d = positions[i] - mesh.center;
+    radius2 = std::max(radius2, glm::dot(d, d));
+  }
+  mesh.radius = std::sqrt(radius2);
+}
+
+void MeshBuffer::upload()
 {
-  auto f = meshes.find(name);
-  if (f == meshes.end()) {
+  assert(vbo == 0 && ibo == 0 && "MeshBuffer uploaded twice.");
+
+  //report what vertex cache optimization did, if asked to (e.g. 'REPORT_VERTEX_CACHE=1 ./main'):
+  if (!vertex_cache_report.empty() && std::getenv("REPORT_VERTEX_CACHE")) {
+    std::cout << vertex_cache_report << std::endl;
+  }
+
+  //the arena keeps vertices with the same attributes together:
+  std::string layout;
+  for (Attrib const *attrib : {&Position, &Normal, &Color, &TexCoord}) {
+    layout += std::to_string(attrib->size) + " " + std::to_string(attrib->type) + " "
+            + std::to_string(attrib->normalized) + " " + std::to_string(attrib->offset) + " "
+            + std::to_string(attrib->stride) + ";";
+  }
+
+  std::vector<std::pair<GLuint, GLuint>> ranges;
+  for (auto const &mesh : meshes) {
+    ranges.emplace_back(GLuint(mesh.base_vertex), mesh.vertex_count);
+  }
+
+  GeometryArena::Range range = geometry_arena.upload(layout, vertex_stride, position_stride, index_type,
+                                                     staged_vertices, staged_positions, staged_elements, ranges);
+  block = range.block;
+  vbo = block->vbo;
+  ibo = block->ibo;
+  for (uint32_t i = 0; i < meshes.size(); ++i) {
+    meshes[i].start += range.first_element;
+    meshes[i].base_vertex += GLint(range.first_vertex);
+    meshes[i].draw_slot = GeometryArena::draw_slot(range.first_mesh + i);
+  }
+
+  //data now lives in GPU memory:
+  std::vector<uint8_t>().swap(staged_vertices);
+  std::vector<uint8_t>().swap(staged_positions);
+  std::vector<uint8_t>().swap(staged_elements);
+}
+
+MeshBuffer::MeshId MeshBuffer::find(std::string const &name) const
+{
+  auto f = ids.find(name);
+  if (f == ids.end()) {
     throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
   }
   return f->second;
 }
 
+const MeshBuffer::Mesh &MeshBuffer::lookup(std::string const &name) const
+{
+  return meshes[find(name)];
+}
+
+//vao cache key bit for programs with per-instance attributes:
+static uint32_t const InstancedKey = 0x80000000;
+
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const
 {
-  //create a new vertex array object:
-  GLuint vao = 0;
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
+  assert(block != nullptr && "MeshBuffer must be uploaded before making vertex arrays for it.");
 
-  //Try to bind all attributes in this buffer:
-  std::set<GLuint> bound;
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib)
+  //attributes in this buffer, at the locations compile_program binds them to:
+  struct
   {
-      if (attrib.size == 0) return; //don't bind empty attribs
-      GLint location = glGetAttribLocation(program, name);
-      if (location == -1) {
-        std::cerr << "WARNING: attribute '" << name << "' in mesh buffer isn't active in program." << std::endl;
-      }
-      else {
-        glVertexAttribPointer(location,
-                              attrib.size,
-                              attrib.type,
-                              attrib.normalized,
-                              attrib.stride,
-                              (GLbyte *) 0 + attrib.offset);
-        glEnableVertexAttribArray(location);
-        bound.insert(location);
-      }
+    char const *name;
+    GLuint location;
+    MeshBuffer::Attrib const &attrib;
+  } const attributes[] = {
+    {"Position", PositionLocation, Position},
+    {"Normal", NormalLocation, Normal},
+    {"Color", ColorLocation, Color},
+    {"TexCoord", TexCoordLocation, TexCoord},
   };
-  bind_attribute("Position", Position);
-  bind_attribute("Normal", Normal);
-  bind_attribute("Color", Color);
-  bind_attribute("TexCoord", TexCoord);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+  uint32_t mesh_locations = 0;
+  for (auto const &a : attributes) {
+    if (a.attrib.size != 0) mesh_locations |= (1U << a.location); //don't bind empty attribs
+  }
 
-  //Check that all active attributes were bound:
+  //Check that all active attributes will be bound, and note if the program reads per-instance attributes:
+  bool instanced = false;
+  uint32_t used = 0;
   GLint active = 0;
   glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
   assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
@@ -223,10 +525,70 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const
     glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
     name[99] = '\0';
     GLint location = glGetAttribLocation(program, name);
-    if (!bound.count(GLuint(location))) {
+    if (location < 0) continue; //built-in (e.g. gl_VertexID)
+    //per-instance attributes are supplied when drawing (see Scene::draw), not by the mesh buffer:
+    if (std::string(name).compare(0, 8, "Instance") == 0) {
+      instanced = true;
+      continue;
+    }
+    //multi-draw programs read draw slots from the arena block (see ObjectUniforms::glsl_multidraw):
+    if (name == std::string("DrawSlot") && GLuint(location) == DrawSlotLocation) {
+      used |= (1U << DrawSlotLocation);
+      continue;
+    }
+    bool bound = false;
+    for (auto const &a : attributes) {
+      if (name == std::string(a.name) && GLuint(location) == a.location && (mesh_locations & (1U << a.location))) {
+        bound = true;
+        used |= (1U << a.location);
+      }
+    }
+    if (!bound) {
       throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
     }
   }
+  for (auto const &a : attributes) {
+    if ((mesh_locations & (1U << a.location)) && !(used & (1U << a.location))) {
+      std::cerr << "WARNING: attribute '" << a.name << "' in mesh buffer isn't active in program." << std::endl;
+    }
+  }
+
+  //programs that read the same attributes share one vertex array object per arena block:
+  // (only attributes the program reads are enabled, so e.g. a depth-only pass fetches nothing but positions;
+  //  Scene::draw re-points the per-instance attributes before every instanced draw, so sharing those is safe too;
+  //  and every buffer in a block has the same layout, so meshes from different files share vaos as well)
+  uint32_t key = used | (instanced ? InstancedKey : 0);
+  auto f = block->vaos.find(key);
+  if (f != block->vaos.end()) return f->second;
+
+  //create a new vertex array object:
+  GLuint vao = 0;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  for (auto const &a : attributes) {
+    if (!(used & (1U << a.location))) continue;
+    //(positions may be in their own stream; see VertexStreams)
+    glBindBuffer(GL_ARRAY_BUFFER, (&a.attrib == &Position && block->position_vbo ? block->position_vbo : vbo));
+    glVertexAttribPointer(a.location,
+                          a.attrib.size,
+                          a.attrib.type,
+                          a.attrib.normalized,
+                          a.attrib.stride,
+                          (GLbyte *) 0 + a.attrib.offset);
+    glEnableVertexAttribArray(a.location);
+  }
+  if (used & (1U << DrawSlotLocation)) {
+    glBindBuffer(GL_ARRAY_BUFFER, block->draw_slot_buffer);
+    glVertexAttribIPointer(DrawSlotLocation, 1, GL_UNSIGNED_BYTE, 1, (GLbyte *) 0);
+    glEnableVertexAttribArray(DrawSlotLocation);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  //element buffer binding is part of vertex array state:
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+  block->vaos.emplace(key, vao);
   return vao;
 }
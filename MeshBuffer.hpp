@@ -1,14 +1,27 @@
 #pragma once
 
 #include "GL.hpp"
+#include "geometry_arena.hpp"
+
+#include <glm/glm.hpp>
+
 #include <map>
+#include <cassert>
+#include <vector>
+#include <string>
 
-//"MeshBuffer" holds a collection of meshes loaded from a file
-// (note that meshes in a single collection will share a vbo/vao)
+//"MeshBuffer" holds a collection of indexed triangle (or, from .pl files, line) meshes loaded from a file
+// (note that meshes in a single collection will share a vbo/ibo/vao -- as will collections with the same
+//  vertex format, since upload() places them in the shared GeometryArena)
 
 struct MeshBuffer
 {
-    GLuint vbo = 0; //OpenGL vertex buffer object containing the meshes' data
+    GLuint vbo = 0; //OpenGL vertex buffer object containing the meshes' data (and, likely, other MeshBuffers')
+                    // (with SeparatePositions, Position is instead read from block->position_vbo)
+    GLuint ibo = 0; //OpenGL element buffer object containing the meshes' triangles (or lines; see 'primitive')
+    GeometryArena::Block *block = nullptr; //arena block holding vbo and ibo
+    GLenum index_type = GL_UNSIGNED_SHORT; //type of elements in ibo (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT)
+    GLenum primitive = GL_TRIANGLES; //what elements make (GL_LINES for '.pl' files; copy to Scene::Object::ProgramInfo::primitive)
 
     //Attrib includes location within the vertex buffer of various attributes:
     // (exactly the parameters to glVertexAttribPointer)
@@ -32,23 +45,83 @@ struct MeshBuffer
     Attrib TexCoord;
 
     //construct from a file:
+    // the extension gives the vertex format, as written by meshes/export-meshes.py:
+    //   .p .pn .pc .pt .pnc .pct .pnt .pnct (float attributes), .qpnct (quantized), .pl (lines)
     // note: will throw if file fails to read.
-    MeshBuffer(std::string const &filename);
+    // (files without an element chunk are triangle soup; identical vertices are merged when loading them)
+    // note: makes no OpenGL calls (so may run on a worker thread); call upload() before drawing.
+    //'streams' says whether positions are interleaved with the other attributes or kept in a tightly packed stream
+    // of their own (so programs that read only Position -- e.g. depth-only passes -- fetch just the positions):
+    enum VertexStreams
+    {
+        Interleaved,
+        SeparatePositions
+    };
+    MeshBuffer(std::string const &filename, VertexStreams streams = Interleaved);
+
+    //copy the data read by the constructor into the geometry arena (setting vbo, ibo, and block):
+    void upload();
 
     //look up a particular mesh in the DB:
     // note: will throw if mesh not found.
     struct Mesh
     {
-        GLuint start = 0;
-        GLuint count = 0;
+        //draw with glDrawElementsBaseVertex(primitive, count, index_type, index_offset(mesh), base_vertex):
+        GLuint start = 0; //first element
+        GLuint count = 0; //number of elements
+        GLint base_vertex = 0; //added to each element (the mesh's vertices start here)
+        //(start and base_vertex are positions in the file's data until upload(), and in the arena block's after)
+        GLuint vertex_count = 0;
+        uint8_t draw_slot = 0; //this mesh's entry in a multi-draw call's "Objects" array (see GeometryArena::draw_slot)
+
+        //object-space position is (Position attribute) * position_scale + position_offset:
+        // (quantized formats store positions relative to each mesh's box; identity otherwise)
+        glm::vec3 position_scale = glm::vec3(1.0f);
+        glm::vec3 position_offset = glm::vec3(0.0f);
+
+        //bounding volumes (in mesh coordinates), computed at load time:
+        glm::vec3 min = glm::vec3(0.0f); //axis-aligned box
+        glm::vec3 max = glm::vec3(0.0f);
+        glm::vec3 center = glm::vec3(0.0f); //sphere
+        float radius = 0.0f;
     };
     const Mesh &lookup(std::string const &name) const;
 
-    //build a vertex array object that links this vbo to attributes to a program:
+    //meshes can also be looked up by name once and then by (stable, dense) id, with no string work:
+    // note: find will throw if mesh not found.
+    typedef uint32_t MeshId;
+    MeshId find(std::string const &name) const;
+    const Mesh &get(MeshId id) const
+    {
+      assert(id < meshes.size() && "Getting mesh with invalid id.");
+      return meshes[id];
+    }
+    MeshId size() const
+    { return MeshId(meshes.size()); }
+
+    //size of one element in ibo:
+    GLuint index_size() const
+    { return (index_type == GL_UNSIGNED_SHORT ? 2 : 4); }
+    //location of a mesh's first element in ibo (as passed to glDrawElements*):
+    GLvoid const *index_offset(Mesh const &mesh) const
+    { return (GLbyte const *) 0 + mesh.start * index_size(); }
+
+    //get a vertex array object that links this vbo to attributes to a program:
     //  will throw if program defines attributes not contained in this buffer
     //  and warn if this buffer contains attributes not active in the program
+    //  (attributes named "Instance..." are per-instance data and are left for the caller to bind)
+    // attributes are at the fixed locations from compile_program.hpp, so the vao is cached (in the arena block) and
+    //  shared by all programs that read the same attributes (only those attributes are enabled)
     GLuint make_vao_for_program(GLuint program) const;
 
     //internals:
-    std::map<std::string, Mesh> meshes;
+    std::vector<Mesh> meshes; //indexed by MeshId
+    std::map<std::string, MeshId> ids;
+    std::vector<uint8_t> staged_vertices; //data for vbo/ibo, kept until upload()
+    std::vector<uint8_t> staged_positions; //(SeparatePositions only)
+    std::vector<uint8_t> staged_elements;
+    std::string vertex_cache_report; //(ACMR before/after reordering; printed by upload() if REPORT_VERTEX_CACHE is set)
+    GLsizei vertex_stride = 0; //bytes per vertex in staged_vertices
+    GLsizei position_stride = 0; //bytes per vertex in staged_positions (0 if positions are interleaved)
+    static void compute_bounds(glm::vec3 const *positions, GLuint count, Mesh *mesh);
 };
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <cassert>
+#include <cstdint>
+
+//"Pool" allocates objects of one type out of fixed-size slabs:
+// - create() and destroy() are O(1) and never touch the system allocator except to add a new slab
+// - destroyed slots are reused by later create() calls
+// - a Handle names a slot plus the generation it was created in, so a handle to a destroyed
+//   object can be detected (get() returns nullptr) even after its slot has been reused.
+
+template<typename T, uint32_t SlabSize = 256>
+struct Pool
+{
+    struct Handle
+    {
+        uint32_t index = -1U;
+        uint32_t generation = 0;
+
+        bool operator==(Handle const &other) const
+        { return index == other.index && generation == other.generation; }
+        bool operator!=(Handle const &other) const
+        { return !(*this == other); }
+    };
+
+    Pool() = default;
+    Pool(Pool const &) = delete;
+    Pool &operator=(Pool const &) = delete;
+
+    ~Pool()
+    {
+      for (uint32_t i = 0; i < slabs.size() * SlabSize; ++i) {
+        Slot &slot = get_slot(i);
+        if (slot.live) {
+          reinterpret_cast<T *>(&slot.storage)->~T();
+        }
+      }
+    }
+
+    //construct a new object in a free slot:
+    template<typename... Args>
+    T *create(Args &&... args)
+    {
+      uint32_t index;
+      if (first_free != -1U) {
+        index = first_free;
+        first_free = get_slot(index).next_free;
+      }
+      else {
+        if (used == slabs.size() * SlabSize) {
+          slabs.emplace_back(new Slab);
+        }
+        index = used++;
+        get_slot(index).index = index;
+      }
+      Slot &slot = get_slot(index);
+      assert(!slot.live);
+      T *t = new(&slot.storage) T(std::forward<Args>(args)...);
+      slot.live = true;
+      slot.next_free = -1U;
+      ++count;
+      return t;
+    }
+
+    //destroy an object created by this pool and make its slot available again:
+    void destroy(T *t)
+    {
+      Slot &slot = slot_of(t);
+      assert(slot.live && "Destroying an object that isn't live in this pool.");
+      t->~T();
+      slot.live = false;
+      slot.generation += 1; //invalidates all outstanding handles to this slot
+      slot.next_free = first_free;
+      first_free = slot.index;
+      --count;
+    }
+
+    //handle for a live object:
+    Handle handle(T const *t) const
+    {
+      Slot const &slot = slot_of(t);
+      assert(slot.live);
+      Handle ret;
+      ret.index = slot.index;
+      ret.generation = slot.generation;
+      return ret;
+    }
+
+    //object named by a handle, or nullptr if that object has since been destroyed:
+    T *get(Handle const &handle) const
+    {
+      if (handle.index >= used) return nullptr;
+      Slot &slot = const_cast<Pool *>(this)->get_slot(handle.index);
+      if (!slot.live || slot.generation != handle.generation) return nullptr;
+      return reinterpret_cast<T *>(&slot.storage);
+    }
+
+    //number of live objects:
+    uint32_t size() const
+    { return count; }
+
+    //internals:
+    struct Slot
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage; //(must be first; see slot_of)
+        uint32_t index = 0;
+        uint32_t generation = 0;
+        uint32_t next_free = -1U;
+        bool live = false;
+    };
+    static_assert(std::is_standard_layout<Slot>::value, "Slot must be standard layout to recover it from T *.");
+
+    struct Slab
+    {
+        Slot slots[SlabSize];
+    };
+
+    Slot &get_slot(uint32_t index)
+    { return slabs[index / SlabSize]->slots[index % SlabSize]; }
+
+    static Slot &slot_of(T const *t)
+    {
+      assert(t);
+      return *reinterpret_cast<Slot *>(const_cast<T *>(t));
+    }
+
+    std::vector<std::unique_ptr<Slab> > slabs;
+    uint32_t used = 0; //slots [0, used) have been handed out at least once
+    uint32_t first_free = -1U; //head of the list of destroyed slots
+    uint32_t count = 0;
+};
@@ -1,31 +1,38 @@
 #include "Scene.hpp"
-#include "read_chunk.hpp"
+#include "mapped_file.hpp"
+#include "object_uniforms.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
-#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
 
-glm::mat4 Scene::Transform::make_local_to_parent() const
+//builds translate * rotate * scale directly (cheaper than multiplying three full matrices):
+static inline glm::mat4 make_trs(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale)
 {
-    return glm::mat4( //translate
-        glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
-        glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
-        glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+    glm::mat3 r = glm::mat3_cast(rotation);
+    return glm::mat4(
+        glm::vec4(r[0] * scale.x, 0.0f),
+        glm::vec4(r[1] * scale.y, 0.0f),
+        glm::vec4(r[2] * scale.z, 0.0f),
         glm::vec4(position, 1.0f)
-    )
-        * glm::mat4_cast(rotation) //rotate
-        * glm::mat4( //scale
-            glm::vec4(scale.x, 0.0f, 0.0f, 0.0f),
-            glm::vec4(0.0f, scale.y, 0.0f, 0.0f),
-            glm::vec4(0.0f, 0.0f, scale.z, 0.0f),
-            glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
-        );
+    );
+}
+
+glm::mat4 Scene::Transform::make_local_to_parent() const
+{
+    return make_trs(get_position(), get_rotation(), get_scale());
 }
 
 glm::mat4 Scene::Transform::make_parent_to_local() const
 {
+    glm::vec3 const &position = get_position();
+    glm::quat const &rotation = get_rotation();
+    glm::vec3 const &scale = get_scale();
+
     glm::vec3 inv_scale;
     inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
     inv_scale.y = (scale.y == 0.0f ? 0.0f : 1.0f / scale.y);
@@ -45,23 +52,127 @@ glm::mat4 Scene::Transform::make_parent_to_local() const
         );
 }
 
-glm::mat4 Scene::Transform::make_local_to_world() const
+glm::mat4 const &Scene::Transform::make_local_to_world() const
 {
-    if (parent) {
-        return parent->make_local_to_world() * make_local_to_parent();
+    TransformStorage &ts = scene->transforms;
+    if (ts.dirty[index] & TransformStorage::DirtyLocalToWorld) {
+        glm::mat4 local_to_world;
+        if (parent) {
+            local_to_world = parent->make_local_to_world() * make_local_to_parent();
+        }
+        else {
+            local_to_world = make_local_to_parent();
+        }
+        ts.local_to_world[index] = local_to_world;
+        ts.dirty[index] &= ~TransformStorage::DirtyLocalToWorld;
     }
-    else {
-        return make_local_to_parent();
+    return ts.local_to_world[index];
+}
+
+glm::mat4 const &Scene::Transform::make_world_to_local() const
+{
+    TransformStorage &ts = scene->transforms;
+    if (ts.dirty[index] & TransformStorage::DirtyWorldToLocal) {
+        glm::mat4 world_to_local;
+        if (parent) {
+            world_to_local = make_parent_to_local() * parent->make_world_to_local();
+        }
+        else {
+            world_to_local = make_parent_to_local();
+        }
+        ts.world_to_local[index] = world_to_local;
+        ts.dirty[index] &= ~TransformStorage::DirtyWorldToLocal;
     }
+    return ts.world_to_local[index];
 }
 
-glm::mat4 Scene::Transform::make_world_to_local() const
+void Scene::Transform::mark_dirty()
 {
-    if (parent) {
-        return make_parent_to_local() * parent->make_world_to_local();
+    TransformStorage &ts = scene->transforms;
+
+    //descendants of a dirty transform are always dirty, so there is no need to go further:
+    if (ts.dirty[index] == TransformStorage::DirtyAll) return;
+
+    ts.dirty[index] = TransformStorage::DirtyAll;
+    for (Transform *child = last_child; child != nullptr; child = child->prev_sibling) {
+        child->mark_dirty();
     }
-    else {
-        return make_parent_to_local();
+}
+
+void Scene::Transform::set_position(glm::vec3 const &position)
+{
+    scene->transforms.position[index] = position;
+    mark_dirty();
+}
+
+void Scene::Transform::set_rotation(glm::quat const &rotation)
+{
+    scene->transforms.rotation[index] = rotation;
+    mark_dirty();
+}
+
+void Scene::Transform::set_scale(glm::vec3 const &scale)
+{
+    scene->transforms.scale[index] = scale;
+    mark_dirty();
+}
+
+std::string const &Scene::Transform::get_name() const
+{
+    static std::string const unnamed;
+    return (name ? *name : unnamed);
+}
+
+//helper to remove an element from one of the name index lists:
+template<typename T>
+static void remove_from(std::vector<T *> &list, T *t)
+{
+    auto f = std::find(list.begin(), list.end(), t);
+    assert(f != list.end());
+    list.erase(f);
+}
+
+void Scene::Transform::set_name(std::string const &name_)
+{
+    if (get_name() == name_) return;
+
+    //cameras and lamps are indexed by their transform's name, so move them along with it:
+    std::vector<Camera *> cameras;
+    std::vector<Lamp *> lamps;
+
+    if (name) {
+        auto f = scene->names.find(*name);
+        assert(f != scene->names.end());
+        NameEntry &entry = f->second;
+        remove_from(entry.transforms, this);
+        for (auto c = entry.cameras.begin(); c != entry.cameras.end();) {
+            if ((*c)->transform == this) {
+                cameras.emplace_back(*c);
+                c = entry.cameras.erase(c);
+            }
+            else ++c;
+        }
+        for (auto l = entry.lamps.begin(); l != entry.lamps.end();) {
+            if ((*l)->transform == this) {
+                lamps.emplace_back(*l);
+                l = entry.lamps.erase(l);
+            }
+            else ++l;
+        }
+        if (entry.transforms.empty()) {
+            assert(entry.cameras.empty() && entry.lamps.empty());
+            scene->names.erase(f);
+        }
+        name = nullptr;
+    }
+
+    if (!name_.empty()) {
+        auto f = scene->names.emplace(name_, NameEntry()).first;
+        name = &f->first;
+        NameEntry &entry = f->second;
+        entry.transforms.emplace_back(this);
+        entry.cameras.insert(entry.cameras.end(), cameras.begin(), cameras.end());
+        entry.lamps.insert(entry.lamps.end(), lamps.begin(), lamps.end());
     }
 }
 
@@ -107,6 +218,13 @@ void Scene::Transform::set_parent(Transform *new_parent, Transform *before)
         }
         if (prev_sibling) prev_sibling->next_sibling = this;
     }
+
+    //keep flat storage's parent slot up to date (and note if parent-before-child order was broken):
+    TransformStorage &ts = scene->transforms;
+    ts.parent[index] = (parent ? parent->index : -1U);
+    if (parent && parent->index > index) ts.unsorted = true;
+
+    mark_dirty();
     DEBUG_assert_valid_pointers();
 }
 
@@ -126,11 +244,11 @@ glm::mat4 Scene::Camera::make_projection() const
 
 //---------------------------
 
-//templated helper functions to avoid having to write the same new/delete code three times:
+//templated helper functions to avoid having to write the same new/delete code four times:
 template<typename T, typename... Args>
-T *list_new(T *&first, Args &&... args)
+T *list_new(Pool<T> &pool, T *&first, Args &&... args)
 {
-    T *t = new T(std::forward<Args>(args)...); //"perfect forwarding"
+    T *t = pool.create(std::forward<Args>(args)...); //"perfect forwarding"
     if (first) {
         t->alloc_next = first;
         first->alloc_prev_next = &t->alloc_next;
@@ -141,7 +259,7 @@ T *list_new(T *&first, Args &&... args)
 }
 
 template<typename T>
-void list_delete(T *t)
+void list_delete(Pool<T> &pool, T *t)
 {
     assert(t && "It is invalid to delete a null scene object [yes this is different than 'delete']");
     assert(t->alloc_prev_next);
@@ -152,52 +270,221 @@ void list_delete(T *t)
     //PARANOIA:
     t->alloc_next = nullptr;
     t->alloc_prev_next = nullptr;
+    pool.destroy(t);
 }
 
 Scene::Transform *Scene::new_transform()
 {
-    return list_new<Scene::Transform>(first_transform);
+    //new transforms have no parent, so appending them keeps the flat storage sorted:
+    TransformStorage &ts = transforms;
+    Transform *transform = list_new<Scene::Transform>(transform_pool, first_transform, this, ts.size());
+    ts.transform.emplace_back(transform);
+    ts.parent.emplace_back(-1U);
+    ts.position.emplace_back(0.0f, 0.0f, 0.0f);
+    ts.rotation.emplace_back(0.0f, 0.0f, 0.0f, 1.0f);
+    ts.scale.emplace_back(1.0f, 1.0f, 1.0f);
+    ts.local_to_world.emplace_back(1.0f);
+    ts.world_to_local.emplace_back(1.0f);
+    ts.dirty.emplace_back(TransformStorage::DirtyAll);
+    return transform;
 }
 
 void Scene::delete_transform(Scene::Transform *transform)
 {
-    list_delete<Scene::Transform>(transform);
+    //remove from name index:
+    transform->set_name("");
+
+    //detach from hierarchy (children become roots):
+    while (transform->last_child) {
+        transform->last_child->set_parent(nullptr);
+    }
+    if (transform->parent) {
+        transform->set_parent(nullptr);
+    }
+
+    //release the flat storage slot by moving the last slot into it:
+    TransformStorage &ts = transforms;
+    uint32_t slot = transform->index;
+    uint32_t last = ts.size() - 1;
+    if (slot != last) {
+        Transform *moved = ts.transform[last];
+        ts.transform[slot] = moved;
+        ts.parent[slot] = ts.parent[last];
+        ts.position[slot] = ts.position[last];
+        ts.rotation[slot] = ts.rotation[last];
+        ts.scale[slot] = ts.scale[last];
+        ts.local_to_world[slot] = ts.local_to_world[last];
+        ts.world_to_local[slot] = ts.world_to_local[last];
+        ts.dirty[slot] = ts.dirty[last];
+        moved->index = slot;
+        for (Transform *child = moved->last_child; child != nullptr; child = child->prev_sibling) {
+            ts.parent[child->index] = slot;
+        }
+        ts.unsorted = true;
+    }
+    ts.transform.pop_back();
+    ts.parent.pop_back();
+    ts.position.pop_back();
+    ts.rotation.pop_back();
+    ts.scale.pop_back();
+    ts.local_to_world.pop_back();
+    ts.world_to_local.pop_back();
+    ts.dirty.pop_back();
+
+    list_delete<Scene::Transform>(transform_pool, transform);
+}
+
+void Scene::sort_transforms()
+{
+    TransformStorage &ts = transforms;
+
+    //depth-first walk from each root gives an order in which parents come before children:
+    std::vector<Transform *> order;
+    order.reserve(ts.size());
+    std::vector<Transform *> stack;
+    for (uint32_t i = 0; i < ts.size(); ++i) {
+        if (ts.transform[i]->parent) continue;
+        stack.emplace_back(ts.transform[i]);
+        while (!stack.empty()) {
+            Transform *t = stack.back();
+            stack.pop_back();
+            order.emplace_back(t);
+            //(pushed last-to-first so that children come out in sibling order)
+            for (Transform *child = t->last_child; child != nullptr; child = child->prev_sibling) {
+                stack.emplace_back(child);
+            }
+        }
+    }
+    assert(order.size() == ts.size());
+
+    //permute all arrays into the new order:
+    TransformStorage sorted;
+    sorted.transform = order;
+    sorted.parent.reserve(order.size());
+    sorted.position.reserve(order.size());
+    sorted.rotation.reserve(order.size());
+    sorted.scale.reserve(order.size());
+    sorted.local_to_world.reserve(order.size());
+    sorted.world_to_local.reserve(order.size());
+    sorted.dirty.reserve(order.size());
+    for (Transform *t : order) {
+        uint32_t old = t->index;
+        sorted.position.emplace_back(ts.position[old]);
+        sorted.rotation.emplace_back(ts.rotation[old]);
+        sorted.scale.emplace_back(ts.scale[old]);
+        sorted.local_to_world.emplace_back(ts.local_to_world[old]);
+        sorted.world_to_local.emplace_back(ts.world_to_local[old]);
+        sorted.dirty.emplace_back(ts.dirty[old]);
+    }
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i]->index = i;
+    }
+    for (Transform *t : order) {
+        sorted.parent.emplace_back(t->parent ? t->parent->index : -1U);
+    }
+    ts = std::move(sorted);
+}
+
+void Scene::update_world_matrices()
+{
+    TransformStorage &ts = transforms;
+    if (ts.unsorted) sort_transforms();
+
+    //parents come before children, so each parent's matrix is final by the time its children read it:
+    uint32_t const count = ts.size();
+    uint32_t const *parent = ts.parent.data();
+    uint8_t *dirty = ts.dirty.data();
+    glm::mat4 *local_to_world = ts.local_to_world.data();
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!(dirty[i] & TransformStorage::DirtyLocalToWorld)) continue;
+        glm::mat4 local_to_parent = make_trs(ts.position[i], ts.rotation[i], ts.scale[i]);
+        if (parent[i] == -1U) {
+            local_to_world[i] = local_to_parent;
+        }
+        else {
+            assert(parent[i] < i);
+            local_to_world[i] = local_to_world[parent[i]] * local_to_parent;
+        }
+        dirty[i] &= ~TransformStorage::DirtyLocalToWorld;
+    }
+}
+
+Scene::NameEntry const &Scene::lookup(std::string const &name) const
+{
+    static NameEntry const empty;
+    auto f = names.find(name);
+    if (f == names.end()) return empty;
+    return f->second;
+}
+
+Scene::Transform *Scene::find_transform(std::string const &name) const
+{
+    NameEntry const &entry = lookup(name);
+    return (entry.transforms.empty() ? nullptr : entry.transforms[0]);
+}
+
+Scene::Camera *Scene::find_camera(std::string const &name) const
+{
+    NameEntry const &entry = lookup(name);
+    return (entry.cameras.empty() ? nullptr : entry.cameras[0]);
+}
+
+Scene::Lamp *Scene::find_lamp(std::string const &name) const
+{
+    NameEntry const &entry = lookup(name);
+    return (entry.lamps.empty() ? nullptr : entry.lamps[0]);
 }
 
 Scene::Object *Scene::new_object(Scene::Transform *transform)
 {
     assert(transform && "Scene::Object must be attached to a transform.");
-    return list_new<Scene::Object>(first_object, transform);
+    draw_queue_dirty = true;
+    return list_new<Scene::Object>(object_pool, first_object, transform);
 }
 
 void Scene::delete_object(Scene::Object *object)
 {
-    list_delete<Scene::Object>(object);
+    draw_queue_dirty = true;
+    list_delete<Scene::Object>(object_pool, object);
 }
 
 Scene::Lamp *Scene::new_lamp(Scene::Transform *transform)
 {
     assert(transform && "Scene::Lamp must be attached to a transform.");
-    return list_new<Scene::Lamp>(first_lamp, transform);
+    Lamp *lamp = list_new<Scene::Lamp>(lamp_pool, first_lamp, transform);
+    if (transform->name) {
+        names[*transform->name].lamps.emplace_back(lamp);
+    }
+    return lamp;
 }
 
 void Scene::delete_lamp(Scene::Lamp *object)
 {
-    list_delete<Scene::Lamp>(object);
+    if (object->transform->name) {
+        remove_from(names[*object->transform->name].lamps, object);
+    }
+    list_delete<Scene::Lamp>(lamp_pool, object);
 }
 
 Scene::Camera *Scene::new_camera(Scene::Transform *transform)
 {
     assert(transform && "Scene::Camera must be attached to a transform.");
-    return list_new<Scene::Camera>(first_camera, transform);
+    Camera *camera = list_new<Scene::Camera>(camera_pool, first_camera, transform);
+    if (transform->name) {
+        names[*transform->name].cameras.emplace_back(camera);
+    }
+    return camera;
 }
 
 void Scene::delete_camera(Scene::Camera *object)
 {
-    list_delete<Scene::Camera>(object);
+    if (object->transform->name) {
+        remove_from(names[*object->transform->name].cameras, object);
+    }
+    list_delete<Scene::Camera>(camera_pool, object);
 }
 
-void Scene::draw(Scene::Camera const *camera, Object::ProgramType program_type) const
+Scene::DrawStats Scene::draw(Scene::Camera const *camera, Object::ProgramType program_type) const
 {
     assert(camera && "Must have a camera to draw scene from.");
     assert(program_type < Object::ProgramTypes);
@@ -205,10 +492,10 @@ void Scene::draw(Scene::Camera const *camera, Object::ProgramType program_type)
     glm::mat4 world_to_camera = camera->transform->make_world_to_local();
     glm::mat4 world_to_clip = camera->make_projection() * world_to_camera;
 
-    draw(world_to_clip, program_type);
+    return draw(world_to_clip, program_type);
 }
 
-void Scene::draw(Scene::Lamp const *lamp, Object::ProgramType program_type) const
+Scene::DrawStats Scene::draw(Scene::Lamp const *lamp, Object::ProgramType program_type) const
 {
     assert(lamp && "Must have a lamp to draw scene from.");
     assert(program_type < Object::ProgramTypes);
@@ -216,64 +503,535 @@ void Scene::draw(Scene::Lamp const *lamp, Object::ProgramType program_type) cons
     glm::mat4 world_to_lamp = lamp->transform->make_world_to_local();
     glm::mat4 world_to_clip = lamp->make_projection() * world_to_lamp;
 
-    draw(world_to_clip, program_type);
+    return draw(world_to_clip, program_type);
+}
+
+//The view volume is where dot(plane, vec4(p, 1.0)) >= 0 for all six planes of a clip matrix:
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    Frustum(glm::mat4 const &to_clip, bool normalize)
+    {
+        glm::vec4 row[4];
+        for (uint32_t r = 0; r < 4; ++r) {
+            row[r] = glm::vec4(to_clip[0][r], to_clip[1][r], to_clip[2][r], to_clip[3][r]);
+        }
+        planes[0] = row[3] + row[0]; //left
+        planes[1] = row[3] - row[0]; //right
+        planes[2] = row[3] + row[1]; //bottom
+        planes[3] = row[3] - row[1]; //top
+        planes[4] = row[3] + row[2]; //near
+        planes[5] = row[3] - row[2]; //far
+        if (normalize) {
+            for (auto &plane : planes) {
+                //(infinite perspective matrices have a far plane with zero normal; it culls nothing, so leave it alone)
+                float len = glm::length(glm::vec3(plane));
+                if (len > 0.0f) plane /= len;
+            }
+        }
+    }
+};
+
+//conservative tests: false only if the object's bounds are certainly outside the view.
+
+//quick test: bounding sphere (already in world space) against normalized world-space planes:
+static bool sphere_in_view(Frustum const &world_frustum, glm::vec3 const &center, float radius)
+{
+    for (auto const &plane : world_frustum.planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+    }
+    return true;
+}
+
+//tighter test: box against object-space planes (only signs matter, so no normalization needed):
+static bool box_in_view(glm::mat4 const &mvp, Scene::Object const &object)
+{
+    Frustum local_frustum(mvp, false);
+    for (auto const &plane : local_frustum.planes) {
+        glm::vec3 farthest = glm::vec3(
+            (plane.x >= 0.0f ? object.bounds_max.x : object.bounds_min.x),
+            (plane.y >= 0.0f ? object.bounds_max.y : object.bounds_min.y),
+            (plane.z >= 0.0f ? object.bounds_max.z : object.bounds_min.z)
+        );
+        if (glm::dot(glm::vec3(plane), farthest) + plane.w < 0.0f) return false;
+    }
+    return true;
+}
+
+//apply an object's position dequantization (see MeshBuffer::Mesh) before a matrix that expects object space:
+// (normals aren't quantized this way, so normal matrices are made from the undequantized matrix)
+static glm::mat4 dequantize(glm::mat4 const &m, Scene::Object::ProgramInfo const &info)
+{
+    return glm::mat4(
+        m[0] * info.position_scale.x,
+        m[1] * info.position_scale.y,
+        m[2] * info.position_scale.z,
+        m * glm::vec4(info.position_offset, 1.0f)
+    );
+}
+
+//location of an indexed object's first element in its vao's element buffer:
+static GLvoid const *element_offset(Scene::Object::ProgramInfo const &info)
+{
+    return (GLbyte const *) 0 + info.start * (info.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, Object::ProgramType program_type) const
+//objects with equal keys can be drawn without any state changes between them (and instanced together):
+static bool same_state(Scene::Object::ProgramInfo const &a, Scene::Object::ProgramInfo const &b)
+{
+    if (a.program != b.program || a.vao != b.vao) return false;
+    for (uint32_t i = 0; i < Scene::Object::ProgramInfo::TextureCount; ++i) {
+        if (a.textures[i] != b.textures[i]) return false;
+    }
+    if (a.instanced_program != b.instanced_program || a.instanced_vao != b.instanced_vao) return false;
+    if (a.index_type != b.index_type || a.base_vertex != b.base_vertex || a.primitive != b.primitive) return false;
+    return a.start == b.start && a.count == b.count;
+}
+
+//objects with equal keys can be drawn by one multi-draw call (if their meshes' draw slots differ):
+static bool same_batch(Scene::Object::ProgramInfo const &a, Scene::Object::ProgramInfo const &b)
+{
+    if (a.program != b.program || a.multidraw_program != b.multidraw_program || a.multidraw_vao != b.multidraw_vao) return false;
+    for (uint32_t i = 0; i < Scene::Object::ProgramInfo::TextureCount; ++i) {
+        if (a.textures[i] != b.textures[i]) return false;
+    }
+    return a.index_type == b.index_type && a.primitive == b.primitive && !b.set_uniforms;
+}
+
+static bool state_less(Scene::Object::ProgramInfo const &a, Scene::Object::ProgramInfo const &b)
+{
+    if (a.program != b.program) return a.program < b.program;
+    if (a.vao != b.vao) return a.vao < b.vao;
+    for (uint32_t i = 0; i < Scene::Object::ProgramInfo::TextureCount; ++i) {
+        if (a.textures[i] != b.textures[i]) return a.textures[i] < b.textures[i];
+    }
+    if (a.instanced_program != b.instanced_program) return a.instanced_program < b.instanced_program;
+    if (a.instanced_vao != b.instanced_vao) return a.instanced_vao < b.instanced_vao;
+    if (a.index_type != b.index_type) return a.index_type < b.index_type;
+    if (a.base_vertex != b.base_vertex) return a.base_vertex < b.base_vertex;
+    if (a.primitive != b.primitive) return a.primitive < b.primitive;
+    if (a.start != b.start) return a.start < b.start;
+    return a.count < b.count;
+}
+
+void Scene::update_draw_queues() const
+{
+    if (!draw_queue_dirty) return;
+
+    std::vector<Object *> sorted;
+    for (uint32_t type = 0; type < Object::ProgramTypes; ++type) {
+        sorted.clear();
+        for (Object *object = first_object; object != nullptr; object = object->alloc_next) {
+            if (object->programs[type].program != 0) sorted.emplace_back(object);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [type](Object const *a, Object const *b) {
+          return state_less(a->programs[type], b->programs[type]);
+        });
+        uint32_t group = 0;
+        for (uint32_t i = 0; i < sorted.size(); ++i) {
+            if (i > 0 && !same_state(sorted[i - 1]->programs[type], sorted[i]->programs[type])) {
+                ++group;
+            }
+            sorted[i]->draw_group[type] = group;
+        }
+    }
+
+    draw_queue_dirty = false;
+}
+
+//maps a float to an unsigned integer with the same ordering:
+static inline uint32_t depth_bits(float depth)
+{
+    uint32_t bits;
+    static_assert(sizeof(bits) == sizeof(depth), "float must be 32 bits.");
+    memcpy(&bits, &depth, sizeof(bits));
+    return (bits & 0x80000000U) ? ~bits : (bits | 0x80000000U);
+}
+
+Scene::DrawStats Scene::draw(glm::mat4 const &world_to_clip, Object::ProgramType program_type) const
 {
     assert(program_type < Object::ProgramTypes);
 
-    for (Scene::Object *object = first_object; object != nullptr; object = object->alloc_next) {
+    scratch_view.world_to_clip = world_to_clip;
+    scratch_view.program_type = program_type;
+    collect(std::vector<View *>{&scratch_view});
+    return draw(scratch_view);
+}
 
-        //don't draw if no program of this type attached to object:
-        if (object->programs[program_type].program == 0) continue;
+void Scene::collect(std::vector<View *> const &views) const
+{
+    update_draw_queues();
 
-        glm::mat4 local_to_world = object->transform->make_local_to_world();
+    std::vector<Frustum> world_frustums;
+    world_frustums.reserve(views.size());
+    for (View *view : views) {
+        assert(view);
+        assert(view->program_type < Object::ProgramTypes);
+        view->items.clear();
+        view->stats = DrawStats();
+        world_frustums.emplace_back(view->world_to_clip, true);
+    }
 
-        //compute modelview+projection (object space to clip space) matrix for this object:
-        glm::mat4 mvp = world_to_clip * local_to_world;
+    //cull objects and collect the visible ones (before doing any OpenGL work):
+    for (Object const *object = first_object; object != nullptr; object = object->alloc_next) {
+        glm::mat4 const &local_to_world = object->transform->make_local_to_world();
 
-        //compute modelview (object space to camera local space) matrix for this object:
-        glm::mat4 mv = local_to_world;
+        //bounding sphere in world space (shared by all views):
+        bool cullable = (object->bounds_radius >= 0.0f);
+        glm::vec3 center = glm::vec3(local_to_world * glm::vec4(object->bounds_center, 1.0f));
+        float radius = 0.0f;
+        if (cullable) {
+            float scale = std::max(glm::length(glm::vec3(local_to_world[0])),
+                                   std::max(glm::length(glm::vec3(local_to_world[1])), glm::length(glm::vec3(local_to_world[2]))));
+            radius = object->bounds_radius * scale;
+        }
 
-        //NOTE: inverse cancels out transpose unless there is scale involved
-        glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+        for (uint32_t v = 0; v < views.size(); ++v) {
+            View &view = *views[v];
 
-        //set up program uniforms:
-        Object::ProgramInfo const &info = object->programs[program_type];
-        glUseProgram(info.program);
-        if (info.mvp_mat4 != -1U) {
-            glUniformMatrix4fv(info.mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
+            //don't draw if no program of this type attached to object:
+            if (object->programs[view.program_type].program == 0) continue;
+
+            if (cullable && !sphere_in_view(world_frustums[v], center, radius)) {
+                view.stats.culled += 1;
+                continue;
+            }
+
+            //compute modelview+projection (object space to clip space) matrix for this object:
+            glm::mat4 mvp = view.world_to_clip * local_to_world;
+
+            if (cullable && !box_in_view(mvp, *object)) {
+                view.stats.culled += 1;
+                continue;
+            }
+
+            //clip-space z of the bounds center increases with distance from the viewer:
+            float depth = (mvp * glm::vec4(object->bounds_center, 1.0f)).z;
+
+            DrawItem item;
+            item.key = (uint64_t(object->draw_group[view.program_type]) << 32) | depth_bits(depth);
+            item.object = object;
+            item.local_to_world = local_to_world;
+            item.mvp = mvp;
+            item.object_offset = 0;
+            view.items.emplace_back(item);
+        }
+    }
+
+    //state groups in queue order, front-to-back within each group:
+    for (View *view : views) {
+        std::sort(view->items.begin(), view->items.end(), [](DrawItem const &a, DrawItem const &b) {
+          return a.key < b.key;
+        });
+    }
+}
+
+Scene::DrawStats Scene::draw(View &view) const
+{
+    Object::ProgramType program_type = view.program_type;
+    glm::mat4 const &world_to_clip = view.world_to_clip;
+    std::vector<DrawItem> &draw_items = view.items;
+    DrawStats &stats = view.stats;
+    stats.drawn = stats.state_changes = stats.draw_calls = stats.batched = 0; //(culled was counted by collect)
+
+    //items [begin, run_end(begin)) are drawn with one call (instanced, if more than one):
+    auto run_end = [&](uint32_t begin) -> uint32_t {
+      Object::ProgramInfo const &info = draw_items[begin].object->programs[program_type];
+      uint32_t end = begin + 1;
+      if (info.instanced_program != 0 && !info.set_uniforms) {
+        uint32_t group = uint32_t(draw_items[begin].key >> 32);
+        while (end < draw_items.size() && uint32_t(draw_items[end].key >> 32) == group) ++end;
+      }
+      return (end - begin >= MinInstances ? end : begin + 1);
+    };
+
+    //items that run_end would draw one at a time, but that have a multi-draw program and share all state except
+    // mesh (and draw slot), are drawn with one call; sets *batch if [begin, call_end(begin)) is such a batch:
+    auto call_end = [&](uint32_t begin, bool *batch) -> uint32_t {
+      *batch = false;
+      uint32_t end = run_end(begin);
+      Object::ProgramInfo const &info = draw_items[begin].object->programs[program_type];
+      if (end != begin + 1 || info.multidraw_program == 0 || info.set_uniforms) return end;
+      static_assert(ObjectUniforms::MultiDrawSlots <= 64, "slots used by a batch are tracked in a uint64_t.");
+      assert(info.draw_slot < ObjectUniforms::MultiDrawSlots);
+      uint64_t slots = (1ULL << info.draw_slot);
+      while (end < draw_items.size() && end - begin < ObjectUniforms::MultiDrawSlots) {
+          Object::ProgramInfo const &next = draw_items[end].object->programs[program_type];
+          if (!same_batch(info, next) || (slots & (1ULL << next.draw_slot)) || run_end(end) != end + 1) break;
+          slots |= (1ULL << next.draw_slot);
+          ++end;
+      }
+      *batch = (end - begin > 1);
+      return (*batch ? end : begin + 1);
+    };
+
+    //write per-object blocks for every object drawn on its own by a program with object_block,
+    // and an "Objects" array for every multi-draw batch:
+    uint32_t blocks = 0;
+    uint32_t arrays = 0;
+    for (uint32_t begin = 0; begin < draw_items.size(); /* later */) {
+        bool batch = false;
+        uint32_t end = call_end(begin, &batch);
+        if (batch) ++arrays;
+        else if (end == begin + 1 && draw_items[begin].object->programs[program_type].object_block) ++blocks;
+        begin = end;
+    }
+    if (blocks + arrays > 0) {
+        if (object_buffer == 0) {
+            GLint alignment = 0;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            alignment = std::max(alignment, 1);
+            object_block_stride = (GLintptr(sizeof(ObjectUniforms::Data)) + alignment - 1) / alignment * alignment;
+            objects_array_stride = (GLintptr(ObjectUniforms::MultiDrawSlots * sizeof(ObjectUniforms::Data)) + alignment - 1)
+                                   / alignment * alignment;
+            glGenBuffers(1, &object_buffer);
         }
-        if (info.mv_mat4 != -1U) {
-            glUniformMatrix4fv(info.mv_mat4, 1, GL_FALSE, glm::value_ptr(mv));
+        GLsizeiptr bytes = blocks * object_block_stride + arrays * objects_array_stride;
+        glBindBuffer(GL_UNIFORM_BUFFER, object_buffer);
+        if (bytes > object_buffer_size) {
+            //grow (discarding old contents; draws already issued keep the storage they were given):
+            object_buffer_size = std::max(bytes, std::max(GLsizeiptr(1 << 20), 2 * object_buffer_size));
+            glBufferData(GL_UNIFORM_BUFFER, object_buffer_size, nullptr, GL_STREAM_DRAW);
+            object_buffer_head = 0;
         }
-        if (info.itmv_mat3 != -1U) {
-            glUniformMatrix3fv(info.itmv_mat3, 1, GL_FALSE, glm::value_ptr(itmv));
+        else if (object_buffer_head + bytes > object_buffer_size) {
+            //wrap around, orphaning the storage that may still be in use:
+            glBufferData(GL_UNIFORM_BUFFER, object_buffer_size, nullptr, GL_STREAM_DRAW);
+            object_buffer_head = 0;
         }
+        uint8_t *mapped = reinterpret_cast<uint8_t *>(glMapBufferRange(GL_UNIFORM_BUFFER, object_buffer_head, bytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        if (!mapped) throw std::runtime_error("Failed to map per-object uniform buffer.");
 
-        if (info.set_uniforms) info.set_uniforms();
+        auto write_block = [&](DrawItem const &item, GLintptr at) {
+            //NOTE: inverse cancels out transpose unless there is scale involved
+            glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(item.local_to_world)));
 
-        //set up program textures:
-        for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
-            if (info.textures[i] != 0) {
-                glActiveTexture(GL_TEXTURE0 + i);
-                glBindTexture(GL_TEXTURE_2D, info.textures[i]);
+            Object::ProgramInfo const &info = item.object->programs[program_type];
+            ObjectUniforms::Data data;
+            data.object_to_clip = dequantize(item.mvp, info);
+            data.object_to_light = dequantize(item.local_to_world, info);
+            data.normal_to_light[0] = glm::vec4(itmv[0], 0.0f);
+            data.normal_to_light[1] = glm::vec4(itmv[1], 0.0f);
+            data.normal_to_light[2] = glm::vec4(itmv[2], 0.0f);
+            memcpy(mapped + (at - object_buffer_head), &data, sizeof(data));
+        };
+
+        GLintptr offset = object_buffer_head;
+        for (uint32_t begin = 0; begin < draw_items.size(); /* later */) {
+            bool batch = false;
+            uint32_t end = call_end(begin, &batch);
+            DrawItem &item = draw_items[begin];
+            if (batch) {
+                //each object's block goes in its mesh's slot (unused slots are left unwritten):
+                for (uint32_t i = begin; i < end; ++i) {
+                    uint8_t slot = draw_items[i].object->programs[program_type].draw_slot;
+                    write_block(draw_items[i], offset + slot * GLintptr(sizeof(ObjectUniforms::Data)));
+                }
+                item.object_offset = offset;
+                offset += objects_array_stride;
+            }
+            else if (end == begin + 1 && item.object->programs[program_type].object_block) {
+                write_block(item, offset);
+                item.object_offset = offset;
+                offset += object_block_stride;
+            }
+            begin = end;
+        }
+
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        object_buffer_head += bytes;
+    }
+
+    //currently bound state (only changes are sent to OpenGL):
+    GLuint bound_program = 0;
+    //(like the rest of the code, draw expects no vertex array object bound on entry and unbinds its own before returning;
+    // other code binds vaos between passes, so the last pass's binding can't be assumed -- or queried without a sync)
+    GLuint bound_vao = 0;
+    GLuint bound_textures[Object::ProgramInfo::TextureCount] = {0, 0, 0, 0};
+    uint32_t active_unit = -1U; //(unknown until the first texture bind; callers may leave any unit active)
+
+    auto bind_program = [&](GLuint program) {
+      if (program != bound_program) {
+        glUseProgram(program);
+        bound_program = program;
+        stats.state_changes += 1;
+      }
+    };
+    auto bind_vao = [&](GLuint vao) {
+      if (vao != bound_vao) {
+        glBindVertexArray(vao);
+        bound_vao = vao;
+        stats.state_changes += 1;
+      }
+    };
+    auto bind_textures = [&](Object::ProgramInfo const &info) {
+      for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
+        if (info.textures[i] != 0 && info.textures[i] != bound_textures[i]) {
+          if (active_unit != i) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            active_unit = i;
+          }
+          glBindTexture(GL_TEXTURE_2D, info.textures[i]);
+          bound_textures[i] = info.textures[i];
+          stats.state_changes += 1;
+        }
+      }
+    };
+
+    for (uint32_t begin = 0; begin < draw_items.size(); /* later */) {
+        Object::ProgramInfo const &info = draw_items[begin].object->programs[program_type];
+
+        bool batch = false;
+        uint32_t end = call_end(begin, &batch);
+        if (batch) {
+            bind_program(info.multidraw_program);
+            glBindBufferRange(GL_UNIFORM_BUFFER, ObjectUniforms::Binding, object_buffer, draw_items[begin].object_offset,
+                              ObjectUniforms::MultiDrawSlots * sizeof(ObjectUniforms::Data));
+            bind_textures(info);
+            bind_vao(info.multidraw_vao);
+
+            multidraw_counts.clear();
+            multidraw_offsets.clear();
+            multidraw_base_vertices.clear();
+            multidraw_firsts.clear();
+            for (uint32_t i = begin; i < end; ++i) {
+                Object::ProgramInfo const &mesh = draw_items[i].object->programs[program_type];
+                multidraw_counts.emplace_back(mesh.count);
+                multidraw_offsets.emplace_back(element_offset(mesh));
+                multidraw_base_vertices.emplace_back(mesh.base_vertex);
+                multidraw_firsts.emplace_back(mesh.start);
+            }
+            if (info.index_type != 0) {
+                glMultiDrawElementsBaseVertex(info.primitive, multidraw_counts.data(), info.index_type,
+                                              multidraw_offsets.data(), GLsizei(end - begin), multidraw_base_vertices.data());
+            }
+            else {
+                glMultiDrawArrays(info.primitive, multidraw_firsts.data(), multidraw_counts.data(), GLsizei(end - begin));
+            }
+            stats.draw_calls += 1;
+            stats.drawn += end - begin;
+            stats.batched += end - begin;
+
+            begin = end;
+            continue;
+        }
+        if (end - begin > 1) {
+            //gather per-instance matrices:
+            instance_data.clear();
+            for (uint32_t i = begin; i < end; ++i) {
+                InstanceData data;
+                data.to_light = dequantize(draw_items[i].local_to_world, info);
+                //NOTE: inverse cancels out transpose unless there is scale involved
+                data.normal_to_light = glm::inverse(glm::transpose(glm::mat3(draw_items[i].local_to_world)));
+                instance_data.emplace_back(data);
+            }
+
+            bind_program(info.instanced_program);
+            if (info.instanced_light_to_clip_mat4 != -1U) {
+                glUniformMatrix4fv(info.instanced_light_to_clip_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+            }
+            bind_textures(info);
+            bind_vao(info.instanced_vao);
+
+            //stream instance data (re-specifying the whole buffer lets the driver hand back fresh storage
+            // instead of waiting for earlier draws that read it):
+            if (instance_buffer == 0) glGenBuffers(1, &instance_buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+            glBufferData(GL_ARRAY_BUFFER, instance_data.size() * sizeof(InstanceData), instance_data.data(), GL_STREAM_DRAW);
+
+            //point the vao's per-instance attributes at instance_buffer:
+            // (every run, since instanced vaos are shared by every Scene drawing the same meshes and each Scene
+            //  streams its own instance_buffer)
+            for (GLuint c = 0; c < 4; ++c) {
+                glVertexAttribPointer(InstanceToLightLocation + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                      (GLbyte *) 0 + offsetof(InstanceData, to_light) + c * sizeof(glm::vec4));
+                glVertexAttribDivisor(InstanceToLightLocation + c, 1);
+                glEnableVertexAttribArray(InstanceToLightLocation + c);
+            }
+            for (GLuint c = 0; c < 3; ++c) {
+                glVertexAttribPointer(InstanceNormalToLightLocation + c, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                      (GLbyte *) 0 + offsetof(InstanceData, normal_to_light) + c * sizeof(glm::vec3));
+                glVertexAttribDivisor(InstanceNormalToLightLocation + c, 1);
+                glEnableVertexAttribArray(InstanceNormalToLightLocation + c);
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            if (info.index_type != 0) {
+                glDrawElementsInstancedBaseVertex(info.primitive, info.count, info.index_type, element_offset(info),
+                                                  GLsizei(end - begin), info.base_vertex);
+            }
+            else {
+                glDrawArraysInstanced(info.primitive, info.start, info.count, GLsizei(end - begin));
+            }
+            stats.draw_calls += 1;
+            stats.drawn += end - begin;
+
+            begin = end;
+            continue;
+        }
+
+        //otherwise, draw a single object:
+        DrawItem const &item = draw_items[begin];
+        begin += 1;
+        stats.drawn += 1;
+
+        //set up program uniforms:
+        bind_program(info.program);
+        if (info.object_block) {
+            glBindBufferRange(GL_UNIFORM_BUFFER, ObjectUniforms::Binding, object_buffer, item.object_offset,
+                              sizeof(ObjectUniforms::Data));
+        }
+        else {
+            //compute modelview (object space to camera local space) matrix for this object:
+            glm::mat4 const &mv = item.local_to_world;
+
+            //NOTE: inverse cancels out transpose unless there is scale involved
+            glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+
+            if (info.mvp_mat4 != -1U) {
+                glm::mat4 mvp = dequantize(item.mvp, info);
+                glUniformMatrix4fv(info.mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
+            }
+            if (info.mv_mat4 != -1U) {
+                glm::mat4 dequantized_mv = dequantize(mv, info);
+                glUniformMatrix4fv(info.mv_mat4, 1, GL_FALSE, glm::value_ptr(dequantized_mv));
+            }
+            if (info.itmv_mat3 != -1U) {
+                glUniformMatrix3fv(info.itmv_mat3, 1, GL_FALSE, glm::value_ptr(itmv));
             }
         }
 
-        glBindVertexArray(info.vao);
+        if (info.set_uniforms) info.set_uniforms();
+
+        //set up program textures:
+        bind_textures(info);
+
+        bind_vao(info.vao);
 
         //draw the object:
-        glDrawArrays(GL_TRIANGLES, info.start, info.count);
+        if (info.index_type != 0) {
+            glDrawElementsBaseVertex(info.primitive, info.count, info.index_type, element_offset(info), info.base_vertex);
+        }
+        else {
+            glDrawArrays(info.primitive, info.start, info.count);
+        }
+        stats.draw_calls += 1;
     }
 
-    //unbind any still bound textures and go back to active texture unit zero:
+    //unbind any textures bound here and go back to active texture unit zero:
     for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        if (bound_textures[i] != 0) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
     }
     glActiveTexture(GL_TEXTURE0);
+    if (bound_vao != 0) glBindVertexArray(0);
+
+    return stats;
 }
 
 Scene::~Scene()
@@ -284,19 +1042,34 @@ Scene::~Scene()
     while (first_object) {
         delete_object(first_object);
     }
+    while (first_lamp) {
+        delete_lamp(first_lamp);
+    }
     while (first_transform) {
         delete_transform(first_transform);
     }
+
+    //buffers are only made by draw, so a scene that was never drawn makes no OpenGL calls here:
+    if (instance_buffer != 0) {
+        glDeleteBuffers(1, &instance_buffer);
+        instance_buffer = 0;
+    }
+    if (object_buffer != 0) {
+        glDeleteBuffers(1, &object_buffer);
+        object_buffer = 0;
+        object_buffer_size = 0;
+    }
 }
 
 void Scene::load(std::string const &filename,
                  std::function<void(Scene &, Transform *, std::string const &)> const &on_object)
 {
 
-    std::ifstream file(filename, std::ios::binary);
+    MappedFile mapped(filename);
+    ChunkReader file(mapped);
 
-    std::vector<char> names;
-    read_chunk(file, "str0", &names);
+    ChunkView<char> strings;
+    read_chunk(file, "str0", &strings);
 
     struct HierarchyEntry
     {
@@ -308,7 +1081,7 @@ void Scene::load(std::string const &filename,
         glm::vec3 scale;
     };
     static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4 * 3 + 4 * 4 + 4 * 3, "HierarchyEntry is packed.");
-    std::vector<HierarchyEntry> hierarchy;
+    ChunkView<HierarchyEntry> hierarchy;
     read_chunk(file, "xfh0", &hierarchy);
 
     struct MeshEntry
@@ -318,7 +1091,7 @@ void Scene::load(std::string const &filename,
         uint32_t name_end;
     };
     static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-    std::vector<MeshEntry> meshes;
+    ChunkView<MeshEntry> meshes;
     read_chunk(file, "msh0", &meshes);
 
     struct CameraEntry
@@ -329,7 +1102,7 @@ void Scene::load(std::string const &filename,
         float clip_near, clip_far;
     };
     static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-    std::vector<CameraEntry> cameras;
+    ChunkView<CameraEntry> cameras;
     read_chunk(file, "cam0", &cameras);
 
     struct LightEntry
@@ -342,10 +1115,10 @@ void Scene::load(std::string const &filename,
         float fov;
     };
     static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-    std::vector<LightEntry> lamps;
+    ChunkView<LightEntry> lamps;
     read_chunk(file, "lmp0", &lamps);
 
-    if (file.peek() != EOF) {
+    if (!file.at_end()) {
         std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
     }
 
@@ -365,17 +1138,17 @@ void Scene::load(std::string const &filename,
             t->set_parent(hierarchy_transforms[h.parent]);
         }
 
-        if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-            t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+        if (h.name_begin <= h.name_end && h.name_end <= strings.size()) {
+            t->set_name(std::string(strings.data() + h.name_begin, strings.data() + h.name_end));
         }
         else {
             throw std::runtime_error(
                 "scene file '" + filename + "' contains hierarchy entry with invalid name indices");
         }
 
-        t->position = h.position;
-        t->rotation = h.rotation;
-        t->scale = h.scale;
+        t->set_position(h.position);
+        t->set_rotation(h.rotation);
+        t->set_scale(h.scale);
 
         hierarchy_transforms.emplace_back(t);
     }
@@ -386,10 +1159,10 @@ void Scene::load(std::string const &filename,
             throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index ("
                                          + std::to_string(m.transform) + ")");
         }
-        if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
+        if (!(m.name_begin <= m.name_end && m.name_end <= strings.size())) {
             throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
         }
-        std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
+        std::string name = std::string(strings.data() + m.name_begin, strings.data() + m.name_end);
 
         if (on_object) {
             on_object(*this, hierarchy_transforms[m.transform], name);
@@ -1,14 +1,17 @@
 #pragma once
 
 #include "GL.hpp"
+#include "Pool.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <vector>
 #include <list>
+#include <cassert>
 #include <functional>
 #include <string>
+#include <unordered_map>
 
 //"Scene" manages a hierarchy of transformations with, potentially, attached information.
 struct Scene
@@ -17,12 +20,22 @@ struct Scene
     struct Transform
     {
         //useful to know sometimes:
-        std::string name;
+        // (names are interned by the owning Scene, which also indexes transforms by name; see Scene::find_transform)
+        std::string const &get_name() const;
+        void set_name(std::string const &name);
 
         //simple specification:
-        glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
-        glm::quat rotation = glm::quat(0.0f, 0.0f, 0.0f, 1.0f);
-        glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+        // (stored in the owning Scene's flat transform arrays; change these through the set_* functions so that
+        //  cached matrices are kept up to date)
+        glm::vec3 const &get_position() const
+        { return scene->transforms.position[index]; }
+        glm::quat const &get_rotation() const
+        { return scene->transforms.rotation[index]; }
+        glm::vec3 const &get_scale() const
+        { return scene->transforms.scale[index]; }
+        void set_position(glm::vec3 const &position);
+        void set_rotation(glm::quat const &rotation);
+        void set_scale(glm::vec3 const &scale);
 
         //hierarchy information:
         Transform *parent = nullptr;
@@ -40,11 +53,20 @@ struct Scene
         //computed from the above:
         glm::mat4 make_local_to_parent() const;
         glm::mat4 make_parent_to_local() const;
-        glm::mat4 make_local_to_world() const;
-        glm::mat4 make_world_to_local() const;
+        //(these two are cached, and only recomputed after this transform or one of its ancestors changes)
+        //(returned references are valid until the next transform is created or deleted)
+        glm::mat4 const &make_local_to_world() const;
+        glm::mat4 const &make_world_to_local() const;
+
+        //flag cached matrices of this transform and all of its descendants as needing recomputation:
+        void mark_dirty();
 
         //constructor/destructor:
-        Transform() = default;
+        Transform(Scene *scene_, uint32_t index_)
+            : scene(scene_), index(index_)
+        {
+          assert(scene);
+        }
         Transform(Transform &) = delete;
         ~Transform()
         {
@@ -59,8 +81,45 @@ struct Scene
         //used by Scene to manage allocation:
         Transform **alloc_prev_next = nullptr;
         Transform *alloc_next = nullptr;
+
+        //used by Scene to locate this transform's data in its flat arrays:
+        Scene *scene;
+        uint32_t index;
+
+        //interned name (a key of scene->names), or nullptr if unnamed:
+        std::string const *name = nullptr;
     };
 
+    //Transform data lives in parallel arrays, kept sorted so that parents come before their children.
+    // This lets update_world_matrices() compute every world matrix in one linear sweep.
+    struct TransformStorage
+    {
+        std::vector<Transform *> transform; //transform using each slot
+        std::vector<uint32_t> parent; //slot of parent transform (or -1U for root transforms)
+        std::vector<glm::vec3> position;
+        std::vector<glm::quat> rotation;
+        std::vector<glm::vec3> scale;
+
+        //cached results of make_local_to_world / make_world_to_local:
+        // (invariant: if a transform is dirty, so are all of its descendants)
+        std::vector<glm::mat4> local_to_world;
+        std::vector<glm::mat4> world_to_local;
+        enum: uint8_t
+        {
+            DirtyLocalToWorld = 1,
+            DirtyWorldToLocal = 2,
+            DirtyAll = DirtyLocalToWorld | DirtyWorldToLocal
+        };
+        std::vector<uint8_t> dirty;
+
+        //set when some transform's slot comes before its parent's slot:
+        bool unsorted = false;
+
+        uint32_t size() const
+        { return uint32_t(transform.size()); }
+    } transforms;
+    //(you shouldn't be manipulating these arrays directly)
+
     //"Object"s contain information needed to render meshes:
     struct Object
     {
@@ -86,11 +145,23 @@ struct Scene
             GLuint vao = 0;
             GLuint start = 0;
             GLuint count = 0;
+            //indexed meshes (see MeshBuffer) are drawn with glDrawElementsBaseVertex:
+            // (start/count are then an element range in the vao's element buffer)
+            GLenum index_type = 0; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT; 0 means draw vertices start..start+count with glDrawArrays
+            GLint base_vertex = 0;
+            GLenum primitive = GL_TRIANGLES; //copy from MeshBuffer::primitive (GL_LINES for '.pl' meshes)
+            //quantized meshes (see MeshBuffer::Mesh) store positions relative to their bounding box;
+            // Scene folds this into the object-to-clip and object-to-light matrices it sends:
+            glm::vec3 position_scale = glm::vec3(1.0f);
+            glm::vec3 position_offset = glm::vec3(0.0f);
 
             //uniforms:
             GLuint mvp_mat4 = -1U; //uniform index for object-to-clip matrix (mat4)
             GLuint mv_mat4 = -1U; //uniform index for model-to-lighting-space matrix (mat4x3)
             GLuint itmv_mat3 = -1U; //uniform index for normal-to-lighting-space matrix (mat3)
+            //(alternative to the uniforms above) program declares the per-object uniform block (see object_uniforms.hpp),
+            // so matrices are streamed into Scene's object buffer and bound with glBindBufferRange:
+            bool object_block = false;
             std::function<void()> set_uniforms; //(optional) function to set additional uniforms
 
             //textures:
@@ -99,8 +170,36 @@ struct Scene
                 TextureCount = 4
             };
             GLuint textures[TextureCount] = {0, 0, 0, 0}; //textures to bind
+
+            //(optional) instanced variant of 'program', used to draw runs of objects that share program, vao,
+            // textures and mesh (start/count) with a single call. It reads object-to-light (mat4) and
+            // normal-to-light (mat3) from per-instance attributes at Scene::InstanceToLightLocation and
+            // Scene::InstanceNormalToLightLocation, and needs a light-to-clip matrix uniform:
+            // (objects with set_uniforms are always drawn one at a time)
+            GLuint instanced_program = 0;
+            GLuint instanced_vao = 0; //vao linking the same vertex data to instanced_program
+            GLuint instanced_light_to_clip_mat4 = -1U; //uniform index for lighting-space-to-clip matrix (mat4)
+
+            //(optional) multi-draw variant of 'program', used to draw runs of objects that share program, vao and
+            // textures -- but not mesh -- with a single glMultiDrawElementsBaseVertex (or glMultiDrawArrays) call.
+            // It reads each object's block from the "Objects" array at the mesh's draw slot (see ObjectUniforms),
+            // so the objects in one call must have different draw slots; Scene splits runs to make sure of that:
+            // (objects with set_uniforms are always drawn one at a time)
+            GLuint multidraw_program = 0;
+            GLuint multidraw_vao = 0; //vao linking the same vertex data (and draw slots) to multidraw_program
+            uint8_t draw_slot = 0; //copy from MeshBuffer::Mesh::draw_slot
         } programs[ProgramTypes];
 
+        //bounding volumes (in local coordinates) used to skip objects that are out of view:
+        // (copy these from the MeshBuffer::Mesh being drawn; objects with negative bounds_radius are never culled)
+        glm::vec3 bounds_min = glm::vec3(0.0f);
+        glm::vec3 bounds_max = glm::vec3(0.0f);
+        glm::vec3 bounds_center = glm::vec3(0.0f);
+        float bounds_radius = -1.0f;
+
+        //used by Scene to order draws: index of the run of objects sharing state and mesh in each program slot:
+        uint32_t draw_group[ProgramTypes] = {0, 0};
+
         //used by Scene to manage allocation:
         Object **alloc_prev_next = nullptr;
         Object *alloc_next = nullptr;
@@ -168,6 +267,7 @@ struct Scene
 
     //------ functions to create / destroy scene things -----
     //NOTE: all scene objects are automatically freed when scene is deallocated
+    //NOTE: scene things are allocated from per-type pools; deleting one frees its slot for reuse
 
     //Create a new transform:
     Transform *new_transform();
@@ -189,6 +289,55 @@ struct Scene
     //Delete a camera:
     void delete_camera(Camera *);
 
+    //re-sort flat transform storage so that parents come before children:
+    void sort_transforms();
+
+    //------ functions to look up scene things by name -----
+    //NOTE: cameras and lamps are found by the name of the transform they are attached to
+
+    //each distinct name is stored once, along with the things that use it:
+    struct NameEntry
+    {
+        std::vector<Transform *> transforms;
+        std::vector<Camera *> cameras;
+        std::vector<Lamp *> lamps;
+    };
+    std::unordered_map<std::string, NameEntry> names;
+
+    //everything with a given name (empty entry if nothing has that name):
+    NameEntry const &lookup(std::string const &name) const;
+
+    //first thing with a given name (nullptr if nothing has that name):
+    Transform *find_transform(std::string const &name) const;
+    Camera *find_camera(std::string const &name) const;
+    Lamp *find_lamp(std::string const &name) const;
+
+    //Handles name scene things without keeping a pointer to them; a handle to a deleted thing
+    // resolves to nullptr, even if the memory has since been reused:
+    typedef Pool<Transform>::Handle TransformHandle;
+    typedef Pool<Object>::Handle ObjectHandle;
+    typedef Pool<Lamp>::Handle LampHandle;
+    typedef Pool<Camera>::Handle CameraHandle;
+
+    TransformHandle handle(Transform const *transform) const
+    { return transform_pool.handle(transform); }
+    ObjectHandle handle(Object const *object) const
+    { return object_pool.handle(object); }
+    LampHandle handle(Lamp const *lamp) const
+    { return lamp_pool.handle(lamp); }
+    CameraHandle handle(Camera const *camera) const
+    { return camera_pool.handle(camera); }
+
+    //returns nullptr if the handle refers to something that has been deleted:
+    Transform *get(TransformHandle const &handle) const
+    { return transform_pool.get(handle); }
+    Object *get(ObjectHandle const &handle) const
+    { return object_pool.get(handle); }
+    Lamp *get(LampHandle const &handle) const
+    { return lamp_pool.get(handle); }
+    Camera *get(CameraHandle const &handle) const
+    { return camera_pool.get(handle); }
+
     //used to manage allocated objects:
     Transform *first_transform = nullptr;
     Object *first_object = nullptr;
@@ -196,22 +345,127 @@ struct Scene
     Camera *first_camera = nullptr;
     //(you shouldn't be manipulating these pointers directly
 
+    //storage for allocated objects:
+    Pool<Transform> transform_pool;
+    Pool<Object> object_pool;
+    Pool<Lamp> lamp_pool;
+    Pool<Camera> camera_pool;
+
     //------ functions to traverse the scene ------
 
+    //Bring every transform's cached local-to-world matrix up to date in a single pass over the flat arrays:
+    // (only transforms that changed since the last call -- and their descendants -- are recomputed)
+    void update_world_matrices();
+
+
+    //Counts reported by the draw functions:
+    struct DrawStats
+    {
+        uint32_t drawn = 0; //objects sent to OpenGL
+        uint32_t culled = 0; //objects skipped because their bounds were outside the view
+        uint32_t state_changes = 0; //program, vertex array, and texture binds issued
+        uint32_t draw_calls = 0; //glDraw* calls issued (one per instanced run or multi-draw batch)
+        uint32_t batched = 0; //objects drawn by multi-draw calls
+    };
+
+    //attribute locations of the per-instance data read by instanced programs:
+    enum: GLuint
+    {
+        InstanceToLightLocation = 4, //mat4 (locations 4-7)
+        InstanceNormalToLightLocation = 8 //mat3 (locations 8-10)
+    };
+    //runs of at least this many objects are drawn with the instanced program:
+    enum: uint32_t
+    {
+        MinInstances = 2
+    };
+
+    //Objects are drawn in an order that groups together objects with the same program, vertex array, and
+    // textures (and, within each group, front-to-back), so only state that differs between consecutive draws is set.
+    //This order is kept between frames and rebuilt after objects are created or deleted.
+    //Call this after changing the program, vao, or textures of an existing object:
+    void invalidate_draw_queue()
+    { draw_queue_dirty = true; }
+
     //Draw the scene from a given camera by computing appropriate matrices and sending all objects to OpenGL:
     //"camera" must be non-null!
-    void draw(Camera const *camera, Object::ProgramType = Object::ProgramTypeDefault) const;
+    DrawStats draw(Camera const *camera, Object::ProgramType = Object::ProgramTypeDefault) const;
 
     //Draw the scene from a given lamp by computing appropriate matrices and sending all objects to OpenGL:
     //"lamp" must be non-null!
-    void draw(Lamp const *lamp, Object::ProgramType = Object::ProgramTypeDefault) const;
+    DrawStats draw(Lamp const *lamp, Object::ProgramType = Object::ProgramTypeDefault) const;
 
     //More general draw function. Will render with a specified projection transformation and use programs in the given slot of all objects:
-    void draw(
+    // (objects whose bounding volumes are entirely outside the view volume are skipped)
+    DrawStats draw(
         glm::mat4 const &world_to_clip,
         Object::ProgramType program_type) const;
 
-    ~Scene(); //destructor deallocates transforms, objects, cameras
+    //------ drawing several views from one traversal ------
+
+    //visible object, as recorded by collect():
+    struct DrawItem
+    {
+        uint64_t key; //state group (high bits) and depth (low bits)
+        Object const *object;
+        glm::mat4 local_to_world;
+        glm::mat4 mvp;
+        GLintptr object_offset; //location of this object's block in object_buffer (if its program uses one)
+                                // (or, for the first object in a multi-draw batch, of the batch's "Objects" array)
+    };
+
+    //A View is one pass over the scene (e.g. a shadow map or a camera):
+    struct View
+    {
+        glm::mat4 world_to_clip = glm::mat4(1.0f);
+        Object::ProgramType program_type = Object::ProgramTypeDefault;
+
+        //filled in by collect():
+        std::vector<DrawItem> items; //visible objects, in draw order
+        DrawStats stats;
+    };
+
+    //Walk all objects once, culling each against every view and filling in each view's visible list:
+    // (so the cost of the walk doesn't grow with the number of views; results don't depend on later transform changes)
+    void collect(std::vector<View *> const &views) const;
+
+    //Send the objects collected for a view to OpenGL:
+    DrawStats draw(View &view) const;
+
+    //retained draw order (see invalidate_draw_queue) is recorded per-object in Object::draw_group:
+    mutable bool draw_queue_dirty = true;
+    void update_draw_queues() const;
+
+    //view used by the single-view draw functions (kept to avoid reallocating every frame):
+    mutable View scratch_view;
+
+    //per-instance data for instanced runs, streamed to instance_buffer for each run:
+    struct InstanceData
+    {
+        glm::mat4 to_light;
+        glm::mat3 normal_to_light;
+    };
+    mutable std::vector<InstanceData> instance_data;
+    mutable GLuint instance_buffer = 0;
+
+    //per-draw parameters for multi-draw batches (kept to avoid reallocating every frame):
+    mutable std::vector<GLsizei> multidraw_counts;
+    mutable std::vector<GLvoid const *> multidraw_offsets; //(indexed meshes)
+    mutable std::vector<GLint> multidraw_base_vertices;
+    mutable std::vector<GLint> multidraw_firsts; //(non-indexed meshes)
+
+    //per-object uniform blocks for programs with object_block, streamed through a ring buffer:
+    // (each draw call writes its blocks just past the previous call's; when the buffer is full it is orphaned and
+    //  writing starts over at the beginning, so the CPU never waits on the GPU to finish reading older blocks)
+    mutable GLuint object_buffer = 0;
+    mutable GLsizeiptr object_buffer_size = 0;
+    mutable GLintptr object_buffer_head = 0; //next byte to write
+    mutable GLintptr object_block_stride = 0; //block size rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    mutable GLintptr objects_array_stride = 0; //size of a multi-draw batch's "Objects" array, similarly rounded
+
+    Scene() = default;
+    Scene(Scene const &) = delete;
+    ~Scene(); //destructor deallocates transforms, objects, lamps, cameras, and the buffers draw streams through
 
     //add transforms/objects/cameras from a scene file:
     // the 'on_object' callback gives you a chance to look up a mesh by name and make an object.
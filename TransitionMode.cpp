@@ -17,6 +17,7 @@
 static GLint fade_program_color = -1;
 static GLint texture_draw_bound = -1;
 static GLint viewport_vec2 = -1;
+static GLint layer_float = -1;
 
 Load<GLuint> fadeout_program(LoadTagInit, []()
 {
@@ -46,7 +47,8 @@ Load<GLuint> expanding_bounds_program(LoadTagInit, []()
         "	gl_Position = vec4(4 * (gl_VertexID & 1) - 1,  2 * (gl_VertexID & 2) - 1, 0.0, 1.0);\n"
         "}\n",
         "#version 330\n"
-        "uniform sampler2D gateway_tex;\n"
+        "uniform sampler2DArray gateway_tex;\n"
+        "uniform float layer;\n"
         "uniform float bounds;\n"
         "uniform vec2 viewport;\n"
         "in vec4 gl_FragCoord;\n"
@@ -58,7 +60,7 @@ Load<GLuint> expanding_bounds_program(LoadTagInit, []()
         "       vec2 norm_coord = gl_FragCoord.xy / viewport;\n"
         "       if (norm_coord.x >= bounds && norm_coord.y >= bounds && \n"
         "           norm_coord.x <= (1.0f - bounds) && norm_coord.y <= (1.0f - bounds)) {\n"
-        "           fragColor = texture(gateway_tex, norm_coord);\n"
+        "           fragColor = texture(gateway_tex, vec3(norm_coord, layer));\n"
         "       } else {\n"
         "           fragColor = vec4(0.0f, 0.0f, 0.0f, 0.0f);\n"
         "       }\n"
@@ -67,12 +69,13 @@ Load<GLuint> expanding_bounds_program(LoadTagInit, []()
 
     texture_draw_bound = glGetUniformLocation(*ret, "bounds");
     viewport_vec2 = glGetUniformLocation(*ret, "viewport");
+    layer_float = glGetUniformLocation(*ret, "layer");
 
     return ret;
 });
 
-TransitionMode::TransitionMode(GLuint target_texture_id, std::shared_ptr<bool> reset)
-    : target_texture_id(target_texture_id), reset(reset)
+TransitionMode::TransitionMode(GLuint target_texture_id, uint32_t target_layer, std::shared_ptr<bool> reset)
+    : target_texture_id(target_texture_id), target_layer(target_layer), reset(reset)
 {}
 
 bool TransitionMode::handle_event(SDL_Event const &e, glm::uvec2 const &window_size)
@@ -106,14 +109,15 @@ void TransitionMode::draw(glm::uvec2 const &drawable_size)
 
         // binding the gateway texture to index 3
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, target_texture_id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, target_texture_id);
 
         glUseProgram(*expanding_bounds_program);
+        glUniform1f(layer_float, float(target_layer));
         glUniform1f(texture_draw_bound, bounds);
         glUniform2fv(viewport_vec2, 1, glm::value_ptr(glm::vec2(drawable_size.x, drawable_size.y)));
         glDrawArrays(GL_TRIANGLES, 0, 3);
 
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
         glUseProgram(0);
 
 
@@ -20,14 +20,15 @@ private:
     void update(float elapsed) override;
     void draw(glm::uvec2 const &drawable_size) override;
 
-    GLuint target_texture_id;
+    GLuint target_texture_id; //a GL_TEXTURE_2D_ARRAY of target images
+    uint32_t target_layer; //layer of target_texture_id to show
     float background_fade = 0.0f;
     float fade_speed = 0.4f;
     float bounds = 1.0f/3.0f;
     float expand_speed = 1.f;
 
 public:
-    TransitionMode(GLuint target_texture_id, std::shared_ptr<bool> reset);
+    TransitionMode(GLuint target_texture_id, uint32_t target_layer, std::shared_ptr<bool> reset);
 
     virtual ~TransitionMode() = default;
 
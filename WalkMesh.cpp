@@ -1,11 +1,10 @@
 #include "WalkMesh.hpp"
 
-#include "read_chunk.hpp"
+#include "mapped_file.hpp"
 
 #include <glm/gtx/norm.hpp>
 
 #include <iostream>
-#include <fstream>
 #include <algorithm>
 #include <string>
 
@@ -228,18 +227,19 @@ void WalkMesh::walk(WalkMesh::WalkPoint &wp, glm::vec3 const &step) const
 
 WalkMeshes::WalkMeshes(std::string const &filename)
 {
-    std::ifstream file(filename, std::ios::binary);
+    MappedFile mapped(filename);
+    ChunkReader file(mapped);
 
-    std::vector<glm::vec3> vertices;
+    ChunkView<glm::vec3> vertices;
     read_chunk(file, "p...", &vertices);
 
-    std::vector<glm::vec3> normals;
+    ChunkView<glm::vec3> normals;
     read_chunk(file, "n...", &normals);
 
-    std::vector<glm::uvec3> triangles;
+    ChunkView<glm::uvec3> triangles;
     read_chunk(file, "tri0", &triangles);
 
-    std::vector<char> names;
+    ChunkView<char> names;
     read_chunk(file, "str0", &names);
 
     struct IndexEntry
@@ -249,10 +249,10 @@ WalkMeshes::WalkMeshes(std::string const &filename)
         uint32_t triangle_begin, triangle_end;
     };
 
-    std::vector<IndexEntry> index;
+    ChunkView<IndexEntry> index;
     read_chunk(file, "idxA", &index);
 
-    if (file.peek() != EOF) {
+    if (!file.at_end()) {
         std::cerr << "WARNING: trailing data in walkmesh file '" << filename << "'" << std::endl;
     }
 
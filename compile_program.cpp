@@ -45,6 +45,13 @@ GLuint compile_program(
     glDeleteShader(vertex_shader);
     glDeleteShader(fragment_shader);
 
+    //fixed locations for mesh attributes (unused names are ignored; layout qualifiers in the shader take precedence):
+    glBindAttribLocation(program, PositionLocation, "Position");
+    glBindAttribLocation(program, NormalLocation, "Normal");
+    glBindAttribLocation(program, ColorLocation, "Color");
+    glBindAttribLocation(program, TexCoordLocation, "TexCoord");
+    glBindAttribLocation(program, DrawSlotLocation, "DrawSlot");
+
     //link the shader program and throw errors if linking fails:
     glLinkProgram(program);
     GLint link_status = GL_FALSE;
@@ -4,6 +4,18 @@
 
 #include <string>
 
+//vertex attribute locations that compile_program binds by name before linking:
+// (so every program reads mesh data from the same locations and programs can share one vertex array object;
+//  see MeshBuffer::make_vao_for_program. Scene's per-instance attributes use locations 4-10.)
+enum: GLuint
+{
+    PositionLocation = 0, //"Position"
+    NormalLocation = 1, //"Normal"
+    ColorLocation = 2, //"Color"
+    TexCoordLocation = 3, //"TexCoord"
+    DrawSlotLocation = 11 //"DrawSlot" (read by multi-draw programs; see ObjectUniforms::glsl_multidraw)
+};
+
 //compiles+links an OpenGL shader program from source.
 // throws on compilation error.
 GLuint compile_program(
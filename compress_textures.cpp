@@ -0,0 +1,86 @@
+#include "s3tc.hpp"
+#include "mip_chain.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstdio>
+
+//compress_textures makes a "[png].s3tc" beside each png it is given (see s3tc.hpp);
+// load_texture uploads those instead of the png whenever they are up to date.
+// '--size WxH' resamples the pngs that follow it to that size first (as load_texture_array does for its layers).
+//e.g.:
+//   compress_textures dist/textures/wood.png dist/textures/marble.png --size 512x512 dist/textures/hst_*.png
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage:\n\t./compress_textures [--size WxH] <file.png> [[--size WxH] <file.png> ...]" << std::endl;
+        return 1;
+    }
+
+    size_t total_uncompressed = 0;
+    size_t total_compressed = 0;
+    try {
+        glm::uvec2 size = glm::uvec2(0); //(0 to keep each png's size)
+        for (int a = 1; a < argc; ++a) {
+            std::string arg = argv[a];
+            if (arg == "--size") {
+                if (a + 1 >= argc || std::sscanf(argv[a + 1], "%ux%u", &size.x, &size.y) != 2 || size.x == 0 || size.y == 0) {
+                    throw std::runtime_error("Expecting a size like '512x512' after --size.");
+                }
+                a += 1;
+                continue;
+            }
+            std::string filename = arg;
+
+            MipChain mips;
+            build_mip_chain(filename, &mips);
+            if (size != glm::uvec2(0) && mips.levels[0].size != size) {
+                std::vector<glm::u8vec4> pixels;
+                resample_mip_chain(mips, size, &pixels);
+                build_mip_chain(size, pixels, &mips);
+            }
+
+            S3TCInfo info;
+            info.source_hash = hash_file(filename);
+            info.version = S3TCVersion;
+            info.format = choose_s3tc_format(mips);
+            info.width = mips.levels[0].size.x;
+            info.height = mips.levels[0].size.y;
+            info.levels = uint32_t(mips.levels.size());
+
+            std::string out_filename = filename + ".s3tc";
+            std::ofstream out(out_filename, std::ios::binary);
+            write_chunk(out, "s3tc", &info, sizeof(info));
+
+            size_t uncompressed = 0;
+            size_t compressed = 0;
+            for (auto const &level : mips.levels) {
+                std::vector<uint8_t> blocks = compress_s3tc(level, S3TCFormat(info.format));
+                write_chunk(out, "blks", blocks.data(), blocks.size());
+                uncompressed += size_t(level.size.x) * level.size.y * 4;
+                compressed += blocks.size();
+            }
+            if (!out) {
+                throw std::runtime_error("Failed to write '" + out_filename + "'.");
+            }
+
+            //report texture memory (all levels) against the RGBA8 upload it replaces:
+            std::cout << filename << ": " << info.width << "x" << info.height << ", " << info.levels << " levels, "
+                      << (info.format == BC1 ? "BC1" : "BC3") << ": " << uncompressed << " -> " << compressed
+                      << " bytes (" << (uncompressed - compressed) << " saved, " << std::fixed << std::setprecision(1)
+                      << double(uncompressed) / double(compressed) << "x)" << std::endl;
+            total_uncompressed += uncompressed;
+            total_compressed += compressed;
+        }
+    } catch (std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Total: " << total_uncompressed << " -> " << total_compressed << " bytes ("
+              << (total_uncompressed - total_compressed) << " saved)." << std::endl;
+    return 0;
+}
@@ -1,32 +1,52 @@
 #include "depth_program.hpp"
 
 #include "compile_program.hpp"
+#include "object_uniforms.hpp"
 
-DepthProgram::DepthProgram()
+DepthProgram::DepthProgram(bool instanced, bool multidraw)
 {
     program = compile_program(
-        "#version 330\n"
-        "uniform mat4 object_to_clip;\n"
+        std::string("#version 330\n")
+        + (instanced ? "#define INSTANCED\n" : "")
+        + (multidraw ? "#define MULTIDRAW\n" : "") +
+        "#ifdef INSTANCED\n"
+        "uniform mat4 light_to_clip;\n"
+        "layout(location=4) in mat4 InstanceToLight;\n" //per-instance (see Scene::InstanceToLightLocation)
+        "#elif defined(MULTIDRAW)\n"
+        + ObjectUniforms::glsl_multidraw +
+        "#else\n"
+        + ObjectUniforms::glsl +
+        "#endif\n"
         "layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
-        "in vec3 Normal;\n" //DEBUG
-        "out vec3 color;\n" //DEBUG
         "void main() {\n"
+        "#ifdef INSTANCED\n"
+        "	gl_Position = light_to_clip * (InstanceToLight * Position);\n"
+        "#else\n"
         "	gl_Position = object_to_clip * Position;\n"
-        "	color = 0.5 + 0.5 * Normal;\n" //DEBUG
+        "#endif\n"
         "}\n",
+        //only depth is written (depth framebuffers have no color attachment):
         "#version 330\n"
-        "in vec3 color;\n" //DEBUG
-        //"uniform vec4 color;\n"
-        "out vec4 fragColor;\n"
         "void main() {\n"
-        "	fragColor = vec4(color, 1.0);\n"
         "}\n"
     );
 
-    object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
+    light_to_clip_mat4 = glGetUniformLocation(program, "light_to_clip");
+
+    ObjectUniforms::bind_program(program);
 }
 
 Load<DepthProgram> depth_program(LoadTagInit, []()
 {
     return new DepthProgram();
 });
+
+Load<DepthProgram> depth_program_instanced(LoadTagInit, []()
+{
+    return new DepthProgram(true);
+});
+
+Load<DepthProgram> depth_program_multidraw(LoadTagInit, []()
+{
+    return new DepthProgram(false, true);
+});
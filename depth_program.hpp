@@ -1,15 +1,20 @@
 #include "GL.hpp"
 #include "Load.hpp"
 
+//DepthProgram writes only depth, reading no mesh attributes but Position (so it can use a position-only vertex
+// stream; see MeshBuffer::SeparatePositions):
 struct DepthProgram
 {
     //opengl program object:
     GLuint program = 0;
 
     //uniform locations:
-    GLuint object_to_clip_mat4 = -1U;
+    GLuint light_to_clip_mat4 = -1U; //(instanced variant only)
+    //(otherwise, object_to_clip is read from the per-object uniform block, or the "Objects" array for the multi-draw variant; see object_uniforms.hpp)
 
-    DepthProgram();
+    DepthProgram(bool instanced = false, bool multidraw = false);
 };
 
 extern Load<DepthProgram> depth_program;
+extern Load<DepthProgram> depth_program_instanced;
+extern Load<DepthProgram> depth_program_multidraw;
@@ -8,13 +8,61 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <vector>
+#include <stdexcept>
+#include <utility>
+#include <cstring>
+#include <cstddef>
+
 //------------ resources ------------
-Load<MeshBuffer> text_meshes(LoadTagInit, []()
+//triangles of each character's mesh in "menu.p", expanded (and kept on the CPU) when loading:
+struct Glyphs
+{
+    std::vector<glm::vec3> positions; //three per triangle
+    //range of 'positions' used by each character (begin is -1U if there is no mesh for it):
+    std::pair<uint32_t, uint32_t> ranges[256];
+};
+
+Load<Glyphs> glyphs(LoadTagInit, []()
 {
-    return new MeshBuffer(data_path("menu.p"));
+    //(only the staged data is used, so the MeshBuffer is never uploaded)
+    MeshBuffer meshes(data_path("menu.p"));
+    if (meshes.primitive != GL_TRIANGLES || meshes.Position.type != GL_FLOAT || meshes.Position.offset != 0) {
+        throw std::runtime_error("Expecting 'menu.p' to hold triangles with float positions.");
+    }
+
+    Glyphs *ret = new Glyphs;
+    for (auto &range : ret->ranges) {
+        range = std::make_pair(-1U, 0U);
+    }
+    for (auto const &id : meshes.ids) {
+        if (id.first.size() != 1) continue;
+        MeshBuffer::Mesh const &mesh = meshes.get(id.second);
+        std::pair<uint32_t, uint32_t> &range = ret->ranges[uint8_t(id.first[0])];
+        range.first = uint32_t(ret->positions.size());
+        for (GLuint e = mesh.start; e < mesh.start + mesh.count; ++e) {
+            uint32_t element = 0;
+            if (meshes.index_type == GL_UNSIGNED_SHORT) {
+                uint16_t element16;
+                memcpy(&element16, &meshes.staged_elements[e * 2], 2);
+                element = element16;
+            }
+            else {
+                memcpy(&element, &meshes.staged_elements[e * 4], 4);
+            }
+            glm::vec3 position;
+            memcpy(&position, &meshes.staged_vertices[(mesh.base_vertex + element) * meshes.Position.stride], sizeof(position));
+            ret->positions.emplace_back(position);
+        }
+        range.second = uint32_t(ret->positions.size());
+    }
+    return [ret]()
+    {
+        return ret;
+    };
 });
 
-//font metrics for "text_meshes":
+//font metrics for "glyphs":
 const constexpr float char_height = 3.0f;
 
 inline float char_width(char a)
@@ -30,67 +78,92 @@ inline float char_spacing(char a, char b)
     return 1.0f;
 }
 
-//Uniform locations in text_program:
-GLint text_program_mvp_mat4 = -1;
+//text vertices, with positions already transformed to the space of their layer:
+struct TextVertex
+{
+    glm::vec4 position;
+    glm::u8vec4 color;
+};
+static_assert(sizeof(TextVertex) == 20, "TextVertex is packed.");
 
-GLint text_program_color_vec4 = -1;
+//"layers" are drawn in order by flush_text, one draw call each:
+enum TextLayer : uint32_t
+{
+    ScreenLayer = 0, //[-aspect,aspect]x[-1,1] (aspect is applied when flushing)
+    ClipLayer = 1, //clip space
+    TextLayers = 2
+};
+static std::vector<TextVertex> text_vertices[TextLayers];
+
+//Uniform locations in text_program:
+GLint text_program_to_clip_mat4 = -1;
 
 Load<GLuint> text_program(LoadTagInit, []()
 {
     GLuint *ret = new GLuint(compile_program(
         "#version 330\n"
-        "uniform mat4 mvp;\n"
+        "uniform mat4 to_clip;\n"
         "in vec4 Position;\n"
+        "in vec4 Color;\n"
+        "out vec4 color;\n"
         "void main() {\n"
-        "	gl_Position = mvp * Position;\n"
+        "	gl_Position = to_clip * Position;\n"
+        "	color = Color;\n"
         "}\n",
         "#version 330\n"
-        "uniform vec4 color;\n"
+        "in vec4 color;\n"
         "out vec4 fragColor;\n"
         "void main() {\n"
         "	fragColor = color;\n"
         "}\n"
     ));
 
-    text_program_mvp_mat4 = glGetUniformLocation(*ret, "mvp");
-    text_program_color_vec4 = glGetUniformLocation(*ret, "color");
+    text_program_to_clip_mat4 = glGetUniformLocation(*ret, "to_clip");
 
     return ret;
 });
 
-//Binding for using text_program on text_meshes:
-Load<GLuint> text_meshes_for_text_program(LoadTagDefault, []()
+//Buffer that text vertices are streamed into each flush, and a vao binding it to text_program:
+struct TextBuffer
+{
+    GLuint vbo = 0;
+    GLuint vao = 0;
+};
+
+Load<TextBuffer> text_buffer(LoadTagDefault, []()
 {
-    return new GLuint(text_meshes->make_vao_for_program(*text_program));
+    TextBuffer *ret = new TextBuffer;
+    glGenBuffers(1, &ret->vbo);
+    glGenVertexArrays(1, &ret->vao);
+    glBindVertexArray(ret->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, ret->vbo);
+    glVertexAttribPointer(PositionLocation, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex),
+                          (GLbyte *) 0 + offsetof(TextVertex, position));
+    glEnableVertexAttribArray(PositionLocation);
+    glVertexAttribPointer(ColorLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TextVertex),
+                          (GLbyte *) 0 + offsetof(TextVertex, color));
+    glEnableVertexAttribArray(ColorLocation);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    return ret;
 });
 
 //----------------------
 
-
-void draw_text(std::string const &text, glm::vec2 const &anchor, float height, glm::vec4 color)
+//append the (transformed) triangles of 'text' to a layer:
+static void add_text(std::string const &text, glm::mat4 const &transform, glm::vec4 const &color, TextLayer layer)
 {
-    GLint viewport[4];
-    glGetIntegerv(GL_VIEWPORT, viewport);
-    float aspect = viewport[2] / float(viewport[3]);
-
-    draw_text(text,
-              glm::mat4(
-                  height / aspect, 0.0f, 0.0f, 0.0f,
-                  0.0f, height, 0.0f, 0.0f,
-                  0.0f, 0.0f, 1.0f, 0.0f,
-                  anchor.x / aspect, anchor.y, 0.0f, 1.0f
-              ), color);
-}
-
-void draw_text(std::string const &text, glm::mat4 const &transform, glm::vec4 color)
-{
-    glUseProgram(*text_program);
-    glBindVertexArray(*text_meshes_for_text_program);
+    glm::u8vec4 color8 = glm::u8vec4(glm::round(glm::clamp(color, 0.0f, 1.0f) * 255.0f));
+    std::vector<TextVertex> &vertices = text_vertices[layer];
 
     float x = 0.0f;
     for (uint32_t i = 0; i < text.size(); ++i) {
         if (i > 0) x += char_spacing(text[i - 1], text[i]);
         if (text[i] != ' ') {
+            std::pair<uint32_t, uint32_t> const &range = glyphs->ranges[uint8_t(text[i])];
+            if (range.first == -1U) {
+                throw std::runtime_error("Looking up mesh '" + text.substr(i, 1) + "' that doesn't exist.");
+            }
             float s = 1.0f / char_height;
             glm::mat4 mvp = transform * glm::mat4(
                 glm::vec4(s, 0.0f, 0.0f, 0.0f),
@@ -98,21 +171,80 @@ void draw_text(std::string const &text, glm::mat4 const &transform, glm::vec4 co
                 glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
                 glm::vec4(s * x, 0.0f, 0.0f, 1.0f)
             );
-            glUniformMatrix4fv(text_program_mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
-            glUniform4fv(text_program_color_vec4, 1, glm::value_ptr(color));
-
-            MeshBuffer::Mesh const &mesh = text_meshes->lookup(text.substr(i, 1));
-            glDrawArrays(GL_TRIANGLES, mesh.start, mesh.count);
+            for (uint32_t p = range.first; p < range.second; ++p) {
+                TextVertex vertex;
+                vertex.position = mvp * glm::vec4(glyphs->positions[p], 1.0f);
+                vertex.color = color8;
+                vertices.emplace_back(vertex);
+            }
         }
 
         x += char_width(text[i]);
     }
+}
+
+void draw_text(std::string const &text, glm::vec2 const &anchor, float height, glm::vec4 color)
+{
+    add_text(text,
+             glm::mat4(
+                 height, 0.0f, 0.0f, 0.0f,
+                 0.0f, height, 0.0f, 0.0f,
+                 0.0f, 0.0f, 1.0f, 0.0f,
+                 anchor.x, anchor.y, 0.0f, 1.0f
+             ), color, ScreenLayer);
+}
+
+void draw_text(std::string const &text, glm::mat4 const &transform, glm::vec4 color)
+{
+    add_text(text, transform, color, ClipLayer);
+}
+
+void flush_text(glm::uvec2 const &drawable_size)
+{
+    size_t total = 0;
+    for (auto const &vertices : text_vertices) {
+        total += vertices.size();
+    }
+    if (total == 0) return;
+
+    //stream every layer's vertices (re-specifying the buffer so the driver need not wait on earlier draws):
+    glBindBuffer(GL_ARRAY_BUFFER, text_buffer->vbo);
+    glBufferData(GL_ARRAY_BUFFER, total * sizeof(TextVertex), nullptr, GL_STREAM_DRAW);
+    size_t first = 0;
+    for (auto const &vertices : text_vertices) {
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(TextVertex), vertices.size() * sizeof(TextVertex), vertices.data());
+        first += vertices.size();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+    glUseProgram(*text_program);
+    glBindVertexArray(text_buffer->vao);
+
+    float aspect = drawable_size.x / float(drawable_size.y);
+    glm::mat4 const to_clip[TextLayers] = {
+        glm::mat4( //ScreenLayer
+            1.0f / aspect, 0.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 1.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 1.0f
+        ),
+        glm::mat4(1.0f) //ClipLayer
+    };
+
+    first = 0;
+    for (uint32_t layer = 0; layer < TextLayers; ++layer) {
+        std::vector<TextVertex> &vertices = text_vertices[layer];
+        if (!vertices.empty()) {
+            glUniformMatrix4fv(text_program_to_clip_mat4, 1, GL_FALSE, glm::value_ptr(to_clip[layer]));
+            glDrawArrays(GL_TRIANGLES, GLint(first), GLsizei(vertices.size()));
+        }
+        first += vertices.size();
+        vertices.clear();
+    }
 
     glBindVertexArray(0);
     glUseProgram(0);
 }
-
 float text_width(std::string const &text, float height)
 {
     float width = 0.0f;
@@ -5,7 +5,8 @@
 #include <string>
 
 //Helper functions to draw text:
-//This version draws relative to a [-aspect,aspect]x[-1,1] screen.
+// (these only add the text's triangles to a batch; call flush_text() to draw everything added so far)
+//This version draws relative to a [-aspect,aspect]x[-1,1] screen (aspect is given to flush_text).
 // the 'anchor' gives the bottom left of the first character.
 void draw_text(std::string const &text,
                glm::vec2 const &anchor,
@@ -17,5 +18,8 @@ void draw_text(std::string const &text,
                glm::mat4 const &transform,
                glm::vec4 color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
 
+//draw all text added since the last flush, with one draw call for each of the two versions above that was used:
+void flush_text(glm::uvec2 const &drawable_size);
+
 //compute the width drawn by 'draw_text' for a string:
 float text_width(std::string const &text, float height);
@@ -0,0 +1,54 @@
+#include "frame_uniforms.hpp"
+
+#include "gl_errors.hpp"
+
+char const * const FrameUniforms::glsl =
+    "layout(std140) uniform Frame {\n"
+    "	mat4 light_to_spot;\n"
+    "	mat4 light_to_target;\n"
+    "	vec3 sun_direction;\n"
+    "	vec3 sun_color;\n"
+    "	vec3 sky_direction;\n"
+    "	vec3 sky_color;\n"
+    "	vec3 spot_position;\n"
+    "	vec3 spot_direction;\n"
+    "	vec3 spot_color;\n"
+    "	vec3 target_position;\n"
+    "	vec3 target_direction;\n"
+    "	vec2 spot_outer_inner;\n"
+    "	vec2 screen_size;\n"
+    "	float gateway_layer;\n"
+    "};\n";
+
+void FrameUniforms::bind_program(GLuint program)
+{
+    GLuint index = glGetUniformBlockIndex(program, "Frame");
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, index, Binding);
+    }
+}
+
+FrameUniforms::FrameUniforms()
+{
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(Data), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, Binding, buffer);
+
+    GL_ERRORS();
+}
+
+void FrameUniforms::upload(Data const &data) const
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    //(re-specifying the whole buffer lets the driver avoid waiting on last frame's draws)
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(Data), &data, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, Binding, buffer);
+}
+
+Load<FrameUniforms> frame_uniforms(LoadTagInit, []()
+{
+    return new FrameUniforms();
+});
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Load.hpp"
+
+#include <glm/glm.hpp>
+
+//FrameUniforms holds per-frame lighting and camera data in a uniform buffer shared by every lit program.
+// Programs paste FrameUniforms::glsl into their shaders and call FrameUniforms::bind_program after linking;
+// the buffer is filled once per frame with upload(), so adding a program costs no extra per-frame uploads.
+struct FrameUniforms
+{
+    //CPU-side copy of the block; layout matches the std140 "Frame" block in 'glsl':
+    struct Data
+    {
+        glm::mat4 light_to_spot = glm::mat4(1.0f); //projects from lighting space (/world space) to spot light depth map space
+        glm::mat4 light_to_target = glm::mat4(1.0f); //projects from lighting space to target view depth map space
+        glm::vec3 sun_direction = glm::vec3(0.0f, 0.0f, 1.0f); //direction *to* sun
+        float pad0 = 0.0f;
+        glm::vec3 sun_color = glm::vec3(0.0f);
+        float pad1 = 0.0f;
+        glm::vec3 sky_direction = glm::vec3(0.0f, 0.0f, 1.0f); //direction *to* sky
+        float pad2 = 0.0f;
+        glm::vec3 sky_color = glm::vec3(0.0f);
+        float pad3 = 0.0f;
+        glm::vec3 spot_position = glm::vec3(0.0f);
+        float pad4 = 0.0f;
+        glm::vec3 spot_direction = glm::vec3(0.0f, 0.0f, -1.0f); //direction *from* spotlight
+        float pad5 = 0.0f;
+        glm::vec3 spot_color = glm::vec3(0.0f);
+        float pad6 = 0.0f;
+        glm::vec3 target_position = glm::vec3(0.0f);
+        float pad7 = 0.0f;
+        glm::vec3 target_direction = glm::vec3(0.0f, 0.0f, -1.0f); //direction *from* target camera
+        float pad8 = 0.0f;
+        glm::vec2 spot_outer_inner = glm::vec2(0.0f); //color fades from zero to one as dot(spot_direction, spot_to_position) varies from outer_inner.x to outer_inner.y
+        glm::vec2 screen_size = glm::vec2(1.0f);
+        float gateway_layer = 0.0f; //layer of the gateway image array to show through the gateway
+        float pad9 = 0.0f;
+        float pad10 = 0.0f;
+        float pad11 = 0.0f;
+    };
+    static_assert(sizeof(Data) == 304, "FrameUniforms::Data must match std140 layout of the Frame block.");
+
+    //declaration of the "Frame" block (include in any shader stage that uses its members):
+    static char const * const glsl;
+
+    //uniform buffer binding point the block is attached to:
+    enum: GLuint
+    {
+        Binding = 0
+    };
+
+    //attach a program's "Frame" block (if it has one) to Binding:
+    static void bind_program(GLuint program);
+
+    //replace the buffer's contents and bind it for drawing:
+    void upload(Data const &data) const;
+
+    GLuint buffer = 0;
+
+    FrameUniforms();
+};
+
+extern Load<FrameUniforms> frame_uniforms;
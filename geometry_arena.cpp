@@ -0,0 +1,103 @@
+#include "geometry_arena.hpp"
+#include "object_uniforms.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+GeometryArena geometry_arena;
+
+uint8_t GeometryArena::draw_slot(uint32_t mesh)
+{
+    static_assert(ObjectUniforms::MultiDrawSlots <= 256, "draw slots are stored in a byte.");
+    return uint8_t(mesh % ObjectUniforms::MultiDrawSlots);
+}
+
+GeometryArena::Range GeometryArena::upload(std::string const &layout, GLsizei stride, GLsizei position_stride,
+                                           GLenum index_type, std::vector<uint8_t> const &vertices,
+                                           std::vector<uint8_t> const &positions, std::vector<uint8_t> const &elements,
+                                           std::vector<std::pair<GLuint, GLuint>> const &meshes)
+{
+    assert(stride > 0);
+    assert(index_type == GL_UNSIGNED_SHORT || index_type == GL_UNSIGNED_INT);
+    GLuint index_size = (index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+    assert(vertices.size() % stride == 0 && elements.size() % index_size == 0);
+    GLuint vertex_count = GLuint(vertices.size() / stride);
+    GLuint element_count = GLuint(elements.size() / index_size);
+    assert(positions.size() == size_t(vertex_count) * position_stride);
+
+    //find a block with matching layout and enough room:
+    Block *block = nullptr;
+    for (auto &b : blocks) {
+        if (b.layout == layout && b.stride == stride && b.position_stride == position_stride && b.index_type == index_type
+         && b.vertex_capacity - b.vertex_count >= vertex_count
+         && b.element_capacity - b.element_count >= element_count) {
+            block = &b;
+            break;
+        }
+    }
+
+    //...or make one:
+    // (buffers are written through the copy-write target so that no vertex array object's element binding changes)
+    if (!block) {
+        blocks.emplace_back();
+        block = &blocks.back();
+        block->layout = layout;
+        block->stride = stride;
+        block->position_stride = position_stride;
+        block->index_type = index_type;
+        block->vertex_capacity = std::max(vertex_count, GLuint(BlockBytes / (stride + position_stride)));
+        block->element_capacity = std::max(element_count, GLuint(BlockBytes / 4 / index_size));
+
+        glGenBuffers(1, &block->vbo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block->vbo);
+        glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(block->vertex_capacity) * stride, nullptr, GL_STATIC_DRAW);
+
+        if (position_stride != 0) {
+            glGenBuffers(1, &block->position_vbo);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, block->position_vbo);
+            glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(block->vertex_capacity) * position_stride, nullptr, GL_STATIC_DRAW);
+        }
+
+        glGenBuffers(1, &block->ibo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block->ibo);
+        glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(block->element_capacity) * index_size, nullptr, GL_STATIC_DRAW);
+
+        glGenBuffers(1, &block->draw_slot_buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block->draw_slot_buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, block->vertex_capacity, nullptr, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    Range range;
+    range.block = block;
+    range.first_vertex = block->vertex_count;
+    range.first_element = block->element_count;
+    range.first_mesh = block->mesh_count;
+
+    //each vertex is tagged with its mesh's draw slot:
+    std::vector<uint8_t> draw_slots(vertex_count, 0);
+    for (uint32_t m = 0; m < meshes.size(); ++m) {
+        assert(meshes[m].first + meshes[m].second <= vertex_count);
+        std::fill(draw_slots.begin() + meshes[m].first, draw_slots.begin() + meshes[m].first + meshes[m].second,
+                  draw_slot(range.first_mesh + m));
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block->vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(range.first_vertex) * stride, vertices.size(), vertices.data());
+    if (position_stride != 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block->position_vbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(range.first_vertex) * position_stride, positions.size(), positions.data());
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block->ibo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(range.first_element) * index_size, elements.size(), elements.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block->draw_slot_buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, range.first_vertex, draw_slots.size(), draw_slots.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    block->vertex_count += vertex_count;
+    block->element_count += element_count;
+    block->mesh_count += uint32_t(meshes.size());
+
+    return range;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <list>
+#include <map>
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdint>
+
+//GeometryArena packs the vertices and elements of every uploaded MeshBuffer into a few large OpenGL buffers,
+// so meshes from different files share buffers (and vertex array objects) and can be drawn together
+// with a single glMultiDraw* call (see Scene::Object::ProgramInfo::multidraw_program).
+
+struct GeometryArena
+{
+    //one vbo of vertices (all in the same layout) and one ibo of elements (all of the same type):
+    struct Block
+    {
+        std::string layout; //identifies the vertex layout (see upload)
+        GLsizei stride = 0;
+        GLsizei position_stride = 0; //(0 if positions are interleaved in vbo)
+        GLenum index_type = 0;
+
+        GLuint vbo = 0;
+        GLuint position_vbo = 0; //positions, tightly packed (if position_stride != 0)
+        GLuint ibo = 0;
+        GLuint draw_slot_buffer = 0; //one byte per vertex: its mesh's draw slot (the "DrawSlot" attribute)
+
+        GLuint vertex_capacity = 0; //in vertices
+        GLuint vertex_count = 0;
+        GLuint element_capacity = 0; //in elements
+        GLuint element_count = 0;
+        uint32_t mesh_count = 0; //meshes placed in this block so far (numbers their draw slots)
+
+        //vertex array objects for this block (see MeshBuffer::make_vao_for_program):
+        std::map<uint32_t, GLuint> vaos;
+    };
+
+    //where a batch of vertices and elements was placed:
+    struct Range
+    {
+        Block *block = nullptr;
+        GLuint first_vertex = 0;
+        GLuint first_element = 0;
+        uint32_t first_mesh = 0; //number (within the block) of the first mesh
+    };
+
+    //copy vertices and elements into a block with the same layout and index type that has room for them,
+    // making a new block if none does:
+    // 'positions' is a separate position stream (position_stride bytes per vertex), or empty if position_stride is 0
+    // 'meshes' gives (first vertex, vertex count) of each mesh in 'vertices'; mesh i is numbered first_mesh + i
+    // (blocks never move or grow, so vertex array objects made for a block stay valid)
+    Range upload(std::string const &layout, GLsizei stride, GLsizei position_stride, GLenum index_type,
+                 std::vector<uint8_t> const &vertices, std::vector<uint8_t> const &positions,
+                 std::vector<uint8_t> const &elements, std::vector<std::pair<GLuint, GLuint>> const &meshes);
+
+    //draw slot of a mesh, by its number within its block:
+    // (meshes drawn together by one multi-draw call must all have different slots)
+    static uint8_t draw_slot(uint32_t mesh);
+
+    //new blocks hold (at least) this many bytes of vertices, and a quarter as many bytes of elements:
+    enum: uint32_t
+    {
+        BlockBytes = 4 << 20
+    };
+
+    std::list<Block> blocks; //(a list, so that Block pointers stay valid)
+};
+
+//all MeshBuffers upload their data here:
+extern GeometryArena geometry_arena;
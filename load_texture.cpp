@@ -0,0 +1,385 @@
+#include "load_texture.hpp"
+
+#include "mip_chain.hpp"
+#include "s3tc.hpp"
+#include "gl_errors.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cstdio>
+
+//The mip cache ("[png].mips", next to the png) is a chunk file:
+// "mips": one CacheInfo
+// "rgba": level 0 pixels (rows bottom-to-top), then one more "rgba" chunk per level, down to 1x1
+struct CacheInfo
+{
+    uint64_t source_hash = 0; //fnv1a_64 of the png's bytes
+    uint32_t version = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levels = 0;
+};
+static_assert(sizeof(CacheInfo) == 24, "CacheInfo is packed");
+
+//bump when the cache layout or the downsampling changes:
+static uint32_t const CacheVersion = 1;
+
+//map the cache and point 'mips' at its levels; false if it is missing, stale, or malformed:
+static bool read_cache(std::string const &cache_filename, uint64_t source_hash, MipChain *mips)
+{
+    {
+        std::ifstream exists(cache_filename, std::ios::binary);
+        if (!exists) return false;
+    }
+    try {
+        std::unique_ptr<MappedFile> file(new MappedFile(cache_filename));
+        ChunkReader reader(*file);
+
+        ChunkView<CacheInfo> info;
+        read_chunk(reader, "mips", &info);
+        if (info.size() != 1 || info[0].version != CacheVersion || info[0].source_hash != source_hash) return false;
+
+        std::vector<glm::uvec2> sizes = mip_level_sizes(glm::uvec2(info[0].width, info[0].height));
+        if (sizes.size() != info[0].levels) return false;
+
+        mips->levels.clear();
+        for (auto const &size : sizes) {
+            ChunkView<uint8_t> pixels;
+            read_chunk(reader, "rgba", &pixels);
+            if (pixels.size() != size_t(size.x) * size.y * 4) return false;
+            MipChain::Level level;
+            level.size = size;
+            level.pixels = pixels.data();
+            mips->levels.emplace_back(level);
+        }
+        if (!reader.at_end()) return false;
+
+        mips->file = std::move(file);
+        return true;
+    } catch (std::exception &e) {
+        std::cerr << "WARNING: ignoring unreadable mip cache '" << cache_filename << "': " << e.what() << std::endl;
+        mips->levels.clear();
+        return false;
+    }
+}
+
+//write the cache beside the png (via a temporary file, so a partly-written cache is never read):
+static void write_cache(std::string const &cache_filename, uint64_t source_hash, MipChain const &mips)
+{
+    std::string temp_filename = cache_filename + ".tmp";
+    {
+        std::ofstream to(temp_filename, std::ios::binary);
+        CacheInfo info;
+        info.source_hash = source_hash;
+        info.version = CacheVersion;
+        info.width = mips.levels[0].size.x;
+        info.height = mips.levels[0].size.y;
+        info.levels = uint32_t(mips.levels.size());
+        write_chunk(to, "mips", &info, sizeof(info));
+        for (auto const &level : mips.levels) {
+            write_chunk(to, "rgba", level.pixels, size_t(level.size.x) * level.size.y * 4);
+        }
+        if (!to) {
+            std::cerr << "WARNING: failed to write mip cache '" << temp_filename << "'." << std::endl;
+            to.close();
+            std::remove(temp_filename.c_str());
+            return;
+        }
+    }
+    std::remove(cache_filename.c_str()); //(rename won't replace an existing file on windows)
+    if (std::rename(temp_filename.c_str(), cache_filename.c_str()) != 0) {
+        std::cerr << "WARNING: failed to move mip cache into place at '" << cache_filename << "'." << std::endl;
+        std::remove(temp_filename.c_str());
+    }
+}
+
+//blocks of each level of a "[png].s3tc" file made by compress_textures, pointing into the mapped file
+// (or into 'storage', for levels compressed at load):
+struct S3TCChain
+{
+    S3TCFormat format = BC1;
+    struct Level
+    {
+        glm::uvec2 size;
+        uint8_t const *blocks = nullptr;
+        size_t bytes = 0;
+    };
+    std::vector<Level> levels;
+
+    std::unique_ptr<MappedFile> file;
+    std::vector<uint8_t> storage;
+};
+
+//map the .s3tc file and point 'chain' at its levels; false if it is missing, out of date, or malformed:
+static bool read_s3tc(std::string const &s3tc_filename, uint64_t source_hash, S3TCChain *chain)
+{
+    {
+        std::ifstream exists(s3tc_filename, std::ios::binary);
+        if (!exists) return false;
+    }
+    try {
+        std::unique_ptr<MappedFile> file(new MappedFile(s3tc_filename));
+        ChunkReader reader(*file);
+
+        ChunkView<S3TCInfo> info;
+        read_chunk(reader, "s3tc", &info);
+        if (info.size() != 1 || info[0].version != S3TCVersion || (info[0].format != BC1 && info[0].format != BC3)) {
+            throw std::runtime_error("unsupported header");
+        }
+        if (info[0].source_hash != source_hash) {
+            std::cerr << "WARNING: '" << s3tc_filename << "' is older than its png (re-run compress_textures);"
+                      << " loading the png instead." << std::endl;
+            return false;
+        }
+        chain->format = S3TCFormat(info[0].format);
+
+        std::vector<glm::uvec2> sizes = mip_level_sizes(glm::uvec2(info[0].width, info[0].height));
+        if (sizes.size() != info[0].levels) throw std::runtime_error("wrong number of levels");
+
+        chain->levels.clear();
+        for (auto const &size : sizes) {
+            ChunkView<uint8_t> blocks;
+            read_chunk(reader, "blks", &blocks);
+            if (blocks.size() != s3tc_level_bytes(chain->format, size)) throw std::runtime_error("wrong level size");
+            S3TCChain::Level level;
+            level.size = size;
+            level.blocks = blocks.data();
+            level.bytes = blocks.size();
+            chain->levels.emplace_back(level);
+        }
+        if (!reader.at_end()) throw std::runtime_error("trailing data");
+
+        chain->file = std::move(file);
+        return true;
+    } catch (std::exception &e) {
+        std::cerr << "WARNING: ignoring unreadable '" << s3tc_filename << "': " << e.what() << std::endl;
+        chain->levels.clear();
+        return false;
+    }
+}
+
+//S3TC is an extension (though every desktop driver has it), so check before uploading compressed levels:
+static bool have_s3tc()
+{
+    static int have = -1;
+    if (have == -1) {
+        have = 0;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i) {
+            char const *name = reinterpret_cast<char const *>(glGetStringi(GL_EXTENSIONS, i));
+            if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) have = 1;
+        }
+    }
+    return have == 1;
+}
+
+static void set_texture_parameters(GLenum target, uint32_t levels)
+{
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, GLint(levels) - 1);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+static GLuint upload_mips(MipChain const &mips)
+{
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    for (uint32_t l = 0; l < mips.levels.size(); ++l) {
+        auto const &level = mips.levels[l];
+        glTexImage2D(GL_TEXTURE_2D, l, GL_RGB, level.size.x, level.size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, level.pixels);
+    }
+    set_texture_parameters(GL_TEXTURE_2D, uint32_t(mips.levels.size()));
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GL_ERRORS();
+
+    return tex;
+}
+
+static GLuint upload_s3tc(S3TCChain const &chain)
+{
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    for (uint32_t l = 0; l < chain.levels.size(); ++l) {
+        auto const &level = chain.levels[l];
+        glCompressedTexImage2D(GL_TEXTURE_2D, l, chain.format, level.size.x, level.size.y, 0,
+                               GLsizei(level.bytes), level.blocks);
+    }
+    set_texture_parameters(GL_TEXTURE_2D, uint32_t(chain.levels.size()));
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GL_ERRORS();
+
+    return tex;
+}
+
+//mip chain of a png, from its cache (rebuilding the cache if it is missing or stale):
+static void load_mip_chain(std::string const &filename, uint64_t source_hash, MipChain *mips)
+{
+    std::string cache_filename = filename + ".mips";
+    if (!read_cache(cache_filename, source_hash, mips)) {
+        build_mip_chain(filename, mips);
+        write_cache(cache_filename, source_hash, *mips);
+    }
+}
+
+std::function<GLuint()> load_texture(std::string const &filename)
+{
+    uint64_t source_hash = hash_file(filename);
+
+    //(shared so that copies of the upload function don't copy the levels)
+    std::shared_ptr<S3TCChain> s3tc = std::make_shared<S3TCChain>();
+    if (read_s3tc(filename + ".s3tc", source_hash, s3tc.get())) {
+        return [filename, s3tc]()
+        {
+            if (have_s3tc()) return upload_s3tc(*s3tc);
+            std::cerr << "WARNING: no S3TC support; decoding '" << filename << "' on the main thread." << std::endl;
+            MipChain mips;
+            build_mip_chain(filename, &mips);
+            return upload_mips(mips);
+        };
+    }
+
+    std::shared_ptr<MipChain> mips = std::make_shared<MipChain>();
+    load_mip_chain(filename, source_hash, mips.get());
+    return [mips]()
+    {
+        return upload_mips(*mips);
+    };
+}
+
+//mip chain of a png resampled to 'size' (see load_texture_array):
+static void load_layer(std::string const &filename, uint64_t source_hash, glm::uvec2 size, MipChain *layer)
+{
+    MipChain mips;
+    load_mip_chain(filename, source_hash, &mips);
+    if (mips.levels[0].size == size) {
+        *layer = std::move(mips);
+    }
+    else {
+        std::vector<glm::u8vec4> pixels;
+        resample_mip_chain(mips, size, &pixels);
+        build_mip_chain(size, pixels, layer);
+    }
+}
+
+//compress every level of 'mips' into 'chain->storage':
+static void compress_layer(MipChain const &mips, S3TCFormat format, S3TCChain *chain)
+{
+    chain->format = format;
+    chain->file.reset();
+    chain->storage.clear();
+    std::vector<size_t> offsets;
+    for (auto const &level : mips.levels) {
+        offsets.emplace_back(chain->storage.size());
+        std::vector<uint8_t> blocks = compress_s3tc(level, format);
+        chain->storage.insert(chain->storage.end(), blocks.begin(), blocks.end());
+    }
+    chain->levels.clear();
+    for (uint32_t l = 0; l < mips.levels.size(); ++l) {
+        S3TCChain::Level level;
+        level.size = mips.levels[l].size;
+        level.blocks = chain->storage.data() + offsets[l];
+        level.bytes = s3tc_level_bytes(format, level.size);
+        chain->levels.emplace_back(level);
+    }
+}
+
+static GLuint upload_mips_array(std::vector<MipChain> const &layers)
+{
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+    std::vector<MipChain::Level> const &levels = layers.front().levels;
+    for (uint32_t l = 0; l < levels.size(); ++l) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_RGB, levels[l].size.x, levels[l].size.y, GLsizei(layers.size()),
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        for (uint32_t i = 0; i < layers.size(); ++i) {
+            auto const &level = layers[i].levels[l];
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, i, level.size.x, level.size.y, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, level.pixels);
+        }
+    }
+    set_texture_parameters(GL_TEXTURE_2D_ARRAY, uint32_t(levels.size()));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    GL_ERRORS();
+
+    return tex;
+}
+
+static GLuint upload_s3tc_array(std::vector<S3TCChain> const &layers)
+{
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+    S3TCFormat format = layers.front().format;
+    std::vector<S3TCChain::Level> const &levels = layers.front().levels;
+    for (uint32_t l = 0; l < levels.size(); ++l) {
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, l, format, levels[l].size.x, levels[l].size.y,
+                               GLsizei(layers.size()), 0, GLsizei(levels[l].bytes * layers.size()), nullptr);
+        for (uint32_t i = 0; i < layers.size(); ++i) {
+            auto const &level = layers[i].levels[l];
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, i, level.size.x, level.size.y, 1,
+                                      format, GLsizei(level.bytes), level.blocks);
+        }
+    }
+    set_texture_parameters(GL_TEXTURE_2D_ARRAY, uint32_t(levels.size()));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    GL_ERRORS();
+
+    return tex;
+}
+
+std::function<GLuint()> load_texture_array(std::vector<std::string> const &filenames, glm::uvec2 size)
+{
+    assert(!filenames.empty());
+
+    //each layer comes from its "[png].s3tc" if that is up to date and already 'size', and is compressed here if not:
+    // (shared so that copies of the upload function don't copy the layers)
+    std::shared_ptr<std::vector<S3TCChain>> layers = std::make_shared<std::vector<S3TCChain>>(filenames.size());
+    std::vector<uint64_t> source_hashes;
+    bool any_bc3 = false;
+    for (uint32_t i = 0; i < filenames.size(); ++i) {
+        source_hashes.emplace_back(hash_file(filenames[i]));
+        S3TCChain &layer = (*layers)[i];
+        if (read_s3tc(filenames[i] + ".s3tc", source_hashes[i], &layer)) {
+            if (layer.levels[0].size == size) {
+                any_bc3 = any_bc3 || (layer.format == BC3);
+                continue;
+            }
+            std::cerr << "WARNING: '" << filenames[i] << ".s3tc' is not " << size.x << "x" << size.y
+                      << "; compressing it at load (re-run compress_textures with --size)." << std::endl;
+        }
+        MipChain mips;
+        load_layer(filenames[i], source_hashes[i], size, &mips);
+        compress_layer(mips, choose_s3tc_format(mips), &layer);
+        any_bc3 = any_bc3 || (layer.format == BC3);
+    }
+    //(all layers of an array share one format)
+    if (any_bc3) {
+        for (uint32_t i = 0; i < filenames.size(); ++i) {
+            if ((*layers)[i].format == BC3) continue;
+            MipChain mips;
+            load_layer(filenames[i], source_hashes[i], size, &mips);
+            compress_layer(mips, BC3, &(*layers)[i]);
+        }
+    }
+
+    return [filenames, size, source_hashes, layers]()
+    {
+        if (have_s3tc()) return upload_s3tc_array(*layers);
+        std::cerr << "WARNING: no S3TC support; decoding texture array layers on the main thread." << std::endl;
+        std::vector<MipChain> mips(filenames.size());
+        for (uint32_t i = 0; i < filenames.size(); ++i) {
+            load_layer(filenames[i], source_hashes[i], size, &mips[i]);
+        }
+        return upload_mips_array(mips);
+    };
+}
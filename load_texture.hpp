@@ -0,0 +1,24 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+//Load a png as a mipmapped, repeating texture, in two steps:
+// load_texture() reads and decodes the file and makes no OpenGL calls (so it may run on a worker thread);
+//  its mip chain is cached in "[filename].mips" (rebuilt whenever the png's contents change),
+//  so later loads map that file instead of decoding the png and generating mipmaps;
+//  if compress_textures has made an up-to-date "[filename].s3tc", its compressed levels are uploaded instead;
+// calling the function it returns creates the texture (so must happen on the thread with the GL context).
+//NOTE: load_texture will throw on error
+std::function<GLuint()> load_texture(std::string const &filename);
+
+//Load pngs as the layers (in order) of a mipmapped, repeating GL_TEXTURE_2D_ARRAY, in the same two steps:
+// every layer is 'size'; pngs of other sizes are resampled to it (so their texture coordinates still span [0,1])
+// layers are S3TC-compressed: from "[filename].s3tc" when compress_textures has made it at 'size' (see --size),
+//  otherwise while loading
+std::function<GLuint()> load_texture_array(std::vector<std::string> const &filenames, glm::uvec2 size);
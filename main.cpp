@@ -1,7 +1,7 @@
 //Mode.hpp declares the "Mode::current" static member variable, which is used to decide where event-handling, updating, and drawing events go:
 #include "Mode.hpp"
 
-//Load.hpp is included because of the call_load_functions() call:
+//Load.hpp is included because of the call_load_functions() and update_background_loads() calls:
 #include "Load.hpp"
 
 //The 'GameMode' mode plays the game:
@@ -165,6 +165,9 @@ int main(int argc, char **argv)
             if (!Mode::current) break;
         }
 
+        //finish any loads whose worker-thread part is done:
+        update_background_loads();
+
         { //(2) call the current mode's "update" function to deal with elapsed time:
             auto current_time = std::chrono::high_resolution_clock::now();
             static auto previous_time = current_time;
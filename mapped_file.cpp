@@ -0,0 +1,75 @@
+#include "mapped_file.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename)
+{
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Failed to open '" + filename + "'.");
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size)) {
+    CloseHandle(file);
+    throw std::runtime_error("Failed to get size of '" + filename + "'.");
+  }
+  file_handle = file;
+  length = size_t(file_size.QuadPart);
+  if (length == 0) return; //(can't map an empty file)
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping == NULL) {
+    CloseHandle(file);
+    throw std::runtime_error("Failed to map '" + filename + "'.");
+  }
+  mapping_handle = mapping;
+  bytes = reinterpret_cast<uint8_t const *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!bytes) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    throw std::runtime_error("Failed to map '" + filename + "'.");
+  }
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::runtime_error("Failed to open '" + filename + "'.");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Failed to get size of '" + filename + "'.");
+  }
+  length = size_t(st.st_size);
+  if (length != 0) {
+    void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Failed to map '" + filename + "'.");
+    }
+    bytes = reinterpret_cast<uint8_t const *>(mapped);
+    //chunks are read front to back, once:
+    madvise(mapped, length, MADV_SEQUENTIAL);
+  }
+  close(fd); //(mapping stays valid)
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(_WIN32)
+  if (bytes) UnmapViewOfFile(bytes);
+  if (mapping_handle) CloseHandle(mapping_handle);
+  if (file_handle) CloseHandle(file_handle);
+#else
+  if (bytes) munmap(const_cast<uint8_t *>(bytes), length);
+#endif
+}
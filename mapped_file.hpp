@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+//"MappedFile" maps a whole file into (read-only) memory:
+// note: will throw if file fails to open or map.
+struct MappedFile
+{
+    MappedFile(std::string const &filename);
+    ~MappedFile();
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    uint8_t const *data() const
+    { return bytes; }
+    size_t size() const
+    { return length; }
+
+    //internals:
+    uint8_t const *bytes = nullptr;
+    size_t length = 0;
+#if defined(_WIN32)
+    void *file_handle = nullptr;
+    void *mapping_handle = nullptr;
+#endif
+};
+
+//"ChunkView" is a typed, bounds-checked view of a chunk's data, pointing straight into a MappedFile:
+// (so it is only valid while the file stays mapped)
+template<typename T>
+struct ChunkView
+{
+    T const *data() const
+    { return items; }
+    size_t size() const
+    { return count; }
+    bool empty() const
+    { return count == 0; }
+
+    T const &operator[](size_t i) const
+    {
+      assert(i < count && "ChunkView index out of range.");
+      return items[i];
+    }
+
+    T const *begin() const
+    { return items; }
+    T const *end() const
+    { return items + count; }
+
+    //internals:
+    T const *items = nullptr;
+    size_t count = 0;
+    //chunks that follow chunks of odd-sized data may not be aligned for T; those (only) are copied here:
+    std::vector<T> unaligned_copy;
+};
+
+//"ChunkReader" walks the chunks in a MappedFile, just like read_chunk() walks the chunks in a stream:
+struct ChunkReader
+{
+    ChunkReader(MappedFile const &file_) : file(file_)
+    {}
+
+    //no more chunks?
+    bool at_end() const
+    { return offset == file.size(); }
+
+    MappedFile const &file;
+    size_t offset = 0;
+};
+
+template<typename T>
+void read_chunk(ChunkReader &from, std::string const &magic, ChunkView<T> *_to)
+{
+    assert(_to);
+    auto &to = *_to;
+
+    struct ChunkHeader
+    {
+        char magic[4] = {'\0', '\0', '\0', '\0'};
+        uint32_t size = 0;
+    };
+    static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+    if (from.file.size() - from.offset < sizeof(ChunkHeader)) {
+        throw std::runtime_error("Failed to read chunk header");
+    }
+    ChunkHeader header;
+    memcpy(&header, from.file.data() + from.offset, sizeof(header));
+    if (std::string(header.magic, 4) != magic) {
+        throw std::runtime_error("Unexpected magic number in chunk");
+    }
+
+    if (header.size % sizeof(T) != 0) {
+        throw std::runtime_error("Size of chunk not divisible by element size");
+    }
+    if (from.file.size() - from.offset - sizeof(ChunkHeader) < header.size) {
+        throw std::runtime_error("Failed to read chunk data.");
+    }
+
+    uint8_t const *begin = from.file.data() + from.offset + sizeof(ChunkHeader);
+    to.count = header.size / sizeof(T);
+    if (reinterpret_cast<uintptr_t>(begin) % alignof(T) == 0) {
+        to.unaligned_copy.clear();
+        to.items = reinterpret_cast<T const *>(begin);
+    }
+    else {
+        to.unaligned_copy.resize(to.count);
+        if (to.count) memcpy(&to.unaligned_copy[0], begin, header.size);
+        to.items = to.unaligned_copy.data();
+    }
+    from.offset += sizeof(ChunkHeader) + header.size;
+}
+
+//magic of the next chunk (without consuming it), or "" if there are no more chunks:
+inline std::string peek_chunk_magic(ChunkReader const &from)
+{
+    if (from.file.size() - from.offset < 4) return "";
+    return std::string(reinterpret_cast<char const *>(from.file.data() + from.offset), 4);
+}
@@ -3,7 +3,7 @@
 # based on 'export-sprites.py' and 'glsprite.py' from TCHOW Rainbow; code used is released into the public domain.
 
 # Note: Script meant to be executed from within blender, as per:
-# blender --background --python export-meshes.py -- <infile.blend>[:layer] <outfile.p[n][c][t]>
+# blender --background --python export-meshes.py -- <infile.blend>[:layer] <outfile[q].p[n][c][t]>
 
 import sys, re
 
@@ -14,7 +14,7 @@ for i in range(0, len(sys.argv)):
 
 if len(args) != 2:
     print(
-        "\n\nUsage:\nblender --background --python export-meshes.py -- <infile.blend>[:layer] <outfile.p[n][c][t][l]>\nExports the meshes referenced by all objects in layer (default 1) to a binary blob, indexed by the names of the objects that reference them. If 'l' is specified in the file extension, only mesh edges will be exported.\n")
+        "\n\nUsage:\nblender --background --python export-meshes.py -- <infile.blend>[:layer] <outfile[q].p[n][c][t][l]>\nExports the meshes referenced by all objects in layer (default 1) to a binary blob, indexed by the names of the objects that reference them. If 'l' is specified in the file extension, only mesh edges will be exported. If 'q' is specified, vertex data is quantized (only '.qpnct' is supported).\n")
     exit(1)
 
 infile = args[0]
@@ -31,30 +31,36 @@ print("Will export meshes referenced from layer " + str(layer) + " of '" + infil
 
 
 class FileType:
-    def __init__(self, magic, as_lines=False):
+    # attributes are the extension's letters (e.g. "pnct"); they are not taken from the magic,
+    #  which is only four characters and so can't name every attribute of a quantized type:
+    def __init__(self, magic, attributes, as_lines=False, quantized=False):
         self.magic = magic
-        self.position = (b"p" in magic)
-        self.normal = (b"n" in magic)
-        self.color = (b"c" in magic)
-        self.texcoord = (b"t" in magic)
+        self.position = ("p" in attributes)
+        self.normal = ("n" in attributes)
+        self.color = ("c" in attributes)
+        self.texcoord = ("t" in attributes)
         self.as_lines = as_lines
+        # quantized: positions as unsigned 16-bit fractions of the mesh's bounding box (x,y,z + padding),
+        #  normals as signed 10:10:10:2, texcoords as half floats:
+        self.quantized = quantized
         self.vertex_bytes = 0
-        if self.position: self.vertex_bytes += 3 * 4
-        if self.normal: self.vertex_bytes += 3 * 4
+        if self.position: self.vertex_bytes += (4 * 2 if quantized else 3 * 4)
+        if self.normal: self.vertex_bytes += (4 if quantized else 3 * 4)
         if self.color: self.vertex_bytes += 4
-        if self.texcoord: self.vertex_bytes += 2 * 4
+        if self.texcoord: self.vertex_bytes += (2 * 2 if quantized else 2 * 4)
 
 
 filetypes = {
-    ".p": FileType(b"p..."),
-    ".pl": FileType(b"p...", True),
-    ".pn": FileType(b"pn.."),
-    ".pc": FileType(b"pc.."),
-    ".pt": FileType(b"pt.."),
-    ".pnc": FileType(b"pnc."),
-    ".pct": FileType(b"pct."),
-    ".pnt": FileType(b"pnt."),
-    ".pnct": FileType(b"pnct"),
+    ".p": FileType(b"p...", "p"),
+    ".pl": FileType(b"p...", "p", as_lines=True),
+    ".pn": FileType(b"pn..", "pn"),
+    ".pc": FileType(b"pc..", "pc"),
+    ".pt": FileType(b"pt..", "pt"),
+    ".pnc": FileType(b"pnc.", "pnc"),
+    ".pct": FileType(b"pct.", "pct"),
+    ".pnt": FileType(b"pnt.", "pnt"),
+    ".pnct": FileType(b"pnct", "pnct"),
+    ".qpnct": FileType(b"qpnc", "pnct", quantized=True),
 }
 
 filetype = None
@@ -85,13 +91,20 @@ for obj in bpy.data.objects:
 # data contains vertex and normal data from the meshes:
 data = b''
 
+# elements contains (per-mesh) indices of the vertices of each triangle (or edge):
+elements = []
+
+# quantization contains the (per-mesh) box that quantized positions are relative to:
+quantization = b''
+
 # strings contains the mesh names:
 strings = b''
 
-# index gives offsets into the data (and names) for each mesh:
+# index gives offsets into the data, elements (and names) for each mesh:
 index = b''
 
 vertex_count = 0
+soup_count = 0  # vertices before merging duplicates (for the report below)
 for obj in bpy.data.objects:
     if obj.data in to_write:
         to_write.remove(obj.data)
@@ -133,7 +146,27 @@ for obj in bpy.data.objects:
     index += struct.pack('I', name_end)
 
     index += struct.pack('I', vertex_count)  # vertex_begin
-    # ...count will be written below
+    # ...vertex_end and element range will be written below
+
+    element_begin = len(elements)
+
+    # identical vertices within a mesh are written once and shared via elements:
+    mesh_vertices = dict()
+
+    def emit(vertex_data):
+        global data, vertex_count, soup_count
+        soup_count += 1
+        if vertex_data not in mesh_vertices:
+            mesh_vertices[vertex_data] = len(mesh_vertices)
+            data += vertex_data
+            vertex_count += 1
+        elements.append(mesh_vertices[vertex_data])
+
+    def quantize_unit(x):
+        return max(0, min(65535, int(round(x * 65535))))
+
+    def quantize_snorm10(x):
+        return max(-511, min(511, int(round(x * 511)))) & 0x3ff
 
     colors = None
     if filetype.color:
@@ -152,6 +185,14 @@ for obj in bpy.data.objects:
             uvs = obj.data.uv_layers.active.data
 
     if not filetype.as_lines:
+        # box for quantized positions (per mesh, so small meshes keep their precision):
+        box_min = [min(v.co[c] for v in mesh.vertices) if len(mesh.vertices) else 0.0 for c in range(0, 3)]
+        box_max = [max(v.co[c] for v in mesh.vertices) if len(mesh.vertices) else 0.0 for c in range(0, 3)]
+        box_size = [box_max[c] - box_min[c] for c in range(0, 3)]
+        if filetype.quantized:
+            quantization += struct.pack('fff', *box_size)  # scale
+            quantization += struct.pack('fff', *box_min)  # offset
+
         # write the mesh triangles:
         for poly in mesh.polygons:
             assert (len(poly.loop_indices) == 3)
@@ -159,59 +200,88 @@ for obj in bpy.data.objects:
                 assert (mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
                 loop = mesh.loops[poly.loop_indices[i]]
                 vertex = mesh.vertices[loop.vertex_index]
-                for x in vertex.co:
-                    data += struct.pack('f', x)
+                vertex_data = b''
+                if filetype.quantized:
+                    q = [quantize_unit((vertex.co[c] - box_min[c]) / box_size[c]) if box_size[c] > 0.0 else 0 for c in range(0, 3)]
+                    vertex_data += struct.pack('HHHH', q[0], q[1], q[2], 0)
+                else:
+                    for x in vertex.co:
+                        vertex_data += struct.pack('f', x)
                 if filetype.normal:
-                    for x in loop.normal:
-                        data += struct.pack('f', x)
+                    if filetype.quantized:
+                        n = loop.normal
+                        vertex_data += struct.pack('I', quantize_snorm10(n[0]) | (quantize_snorm10(n[1]) << 10) | (quantize_snorm10(n[2]) << 20))
+                    else:
+                        for x in loop.normal:
+                            vertex_data += struct.pack('f', x)
                 if filetype.color:
                     if colors != None:
                         col = colors[poly.loop_indices[i]].color
-                        data += struct.pack('BBBB', int(col.r * 255), int(col.g * 255), int(col.b * 255), 255)
+                        vertex_data += struct.pack('BBBB', int(col.r * 255), int(col.g * 255), int(col.b * 255), 255)
                     else:
-                        data += struct.pack('BBBB', 255, 255, 255, 255)
+                        vertex_data += struct.pack('BBBB', 255, 255, 255, 255)
                 if filetype.texcoord:
-                    if uvs != None:
-                        uv = uvs[poly.loop_indices[i]].uv
-                        data += struct.pack('ff', uv.x, uv.y)
-                    else:
-                        data += struct.pack('ff', 0, 0)
-        vertex_count += len(mesh.polygons) * 3
+                    uv = (uvs[poly.loop_indices[i]].uv.x, uvs[poly.loop_indices[i]].uv.y) if uvs != None else (0, 0)
+                    vertex_data += struct.pack('ee' if filetype.quantized else 'ff', uv[0], uv[1])
+                emit(vertex_data)
     else:
         # write the mesh edges:
+        assert (not filetype.quantized)
         for edge in mesh.edges:
             assert (len(edge.vertices) == 2)
             for i in range(0, 2):
                 vertex = mesh.vertices[edge.vertices[i]]
+                vertex_data = b''
                 for x in vertex.co:
-                    data += struct.pack('f', x)
+                    vertex_data += struct.pack('f', x)
                 # None of these are unique on edges:
                 assert (not filetype.normal)
                 assert (not filetype.color)
                 assert (not filetype.texcoord)
-        vertex_count += len(mesh.edges) * 2
+                emit(vertex_data)
 
     index += struct.pack('I', vertex_count)  # vertex_end
+    index += struct.pack('I', element_begin)  # element_begin
+    index += struct.pack('I', len(elements))  # element_end
 
 # check that we wrote as much data as anticipated:
 assert (vertex_count * filetype.vertex_bytes == len(data))
 
+# elements are relative to the start of their mesh, so 16 bits are enough unless some mesh is huge:
+if max([0] + elements) < 0x10000:
+    element_magic = b'e16.'
+    element_data = struct.pack(str(len(elements)) + 'H', *elements)
+else:
+    element_magic = b'e32.'
+    element_data = struct.pack(str(len(elements)) + 'I', *elements)
+
 # write the data chunk and index chunk to an output blob:
 blob = open(outfile, 'wb')
 # first chunk: the data
 blob.write(struct.pack('4s', filetype.magic))  # type
 blob.write(struct.pack('I', len(data)))  # length
 blob.write(data)
-# second chunk: the strings
+# (quantized types only) the position boxes:
+if filetype.quantized:
+    blob.write(struct.pack('4s', b'qnt0'))  # type
+    blob.write(struct.pack('I', len(quantization)))  # length
+    blob.write(quantization)
+# second chunk: the elements
+blob.write(struct.pack('4s', element_magic))  # type
+blob.write(struct.pack('I', len(element_data)))  # length
+blob.write(element_data)
+# third chunk: the strings
 blob.write(struct.pack('4s', b'str0'))  # type
 blob.write(struct.pack('I', len(strings)))  # length
 blob.write(strings)
-# third chunk: the index
-blob.write(struct.pack('4s', b'idx0'))  # type
+# fourth chunk: the index
+blob.write(struct.pack('4s', b'idx1'))  # type
 blob.write(struct.pack('I', len(index)))  # length
 blob.write(index)
 wrote = blob.tell()
 blob.close()
 
 print("Wrote " + str(wrote) + " bytes [== " + str(len(data) + 8) + " bytes of data + " + str(
+    len(element_data) + 8) + " bytes of elements + " + str(
     len(strings) + 8) + " bytes of strings + " + str(len(index) + 8) + " bytes of index] to '" + outfile + "'")
+print("Merged " + str(soup_count) + " vertices into " + str(vertex_count) + " unique vertices.")
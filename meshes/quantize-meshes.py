@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+
+# Makes a quantized '.qpnct' mesh blob from an exported '.pnct' blob, for meshes whose .blend isn't available.
+# (writes exactly what export-meshes.py writes for '.qpnct', but without needing blender)
+#
+# Usage:
+#   python3 quantize-meshes.py <infile.pnct> <outfile.qpnct>
+
+import sys
+import struct
+
+if len(sys.argv) != 3 or not sys.argv[1].endswith(".pnct") or not sys.argv[2].endswith(".qpnct"):
+    print("\n\nUsage:\npython3 quantize-meshes.py <infile.pnct> <outfile.qpnct>\n")
+    exit(1)
+
+infile = sys.argv[1]
+outfile = sys.argv[2]
+
+# read all chunks of the input blob:
+chunks = dict()
+blob = open(infile, 'rb').read()
+at = 0
+while at < len(blob):
+    magic, length = struct.unpack('4sI', blob[at:at + 8])
+    chunks[magic] = blob[at + 8:at + 8 + length]
+    at += 8 + length
+
+vertex_bytes = 3 * 4 + 3 * 4 + 4 + 2 * 4
+pnct = chunks[b'pnct']
+assert len(pnct) % vertex_bytes == 0
+vertices = [struct.unpack('3f3f4B2f', pnct[i:i + vertex_bytes]) for i in range(0, len(pnct), vertex_bytes)]
+strings = chunks[b'str0']
+
+# each mesh as its name's range in strings and a list of (position, normal, color, texcoord) corners, in triangle order:
+meshes = []
+if b'idx1' in chunks:
+    if b'e16.' in chunks:
+        in_elements = struct.unpack(str(len(chunks[b'e16.']) // 2) + 'H', chunks[b'e16.'])
+    else:
+        in_elements = struct.unpack(str(len(chunks[b'e32.']) // 4) + 'I', chunks[b'e32.'])
+    for i in range(0, len(chunks[b'idx1']), 24):
+        name_begin, name_end, vertex_begin, vertex_end, element_begin, element_end = struct.unpack('6I', chunks[b'idx1'][i:i + 24])
+        meshes.append((name_begin, name_end, [vertices[vertex_begin + e] for e in in_elements[element_begin:element_end]]))
+else:
+    # (triangle soup)
+    for i in range(0, len(chunks[b'idx0']), 16):
+        name_begin, name_end, vertex_begin, vertex_end = struct.unpack('4I', chunks[b'idx0'][i:i + 16])
+        meshes.append((name_begin, name_end, vertices[vertex_begin:vertex_end]))
+
+
+def quantize_unit(x):
+    return max(0, min(65535, int(round(x * 65535))))
+
+
+def quantize_snorm10(x):
+    return max(-511, min(511, int(round(x * 511)))) & 0x3ff
+
+
+data = b''
+elements = []
+quantization = b''
+index = b''
+vertex_count = 0
+soup_count = 0
+for name_begin, name_end, corners in meshes:
+    print("Writing '" + strings[name_begin:name_end].decode("utf8") + "'...")
+    index += struct.pack('II', name_begin, name_end)
+    index += struct.pack('I', vertex_count)  # vertex_begin
+    element_begin = len(elements)
+
+    # box for quantized positions (per mesh, as export-meshes.py does):
+    box_min = [min(v[c] for v in corners) if len(corners) else 0.0 for c in range(0, 3)]
+    box_max = [max(v[c] for v in corners) if len(corners) else 0.0 for c in range(0, 3)]
+    box_size = [box_max[c] - box_min[c] for c in range(0, 3)]
+    quantization += struct.pack('fff', *box_size)  # scale
+    quantization += struct.pack('fff', *box_min)  # offset
+
+    mesh_vertices = dict()
+    for v in corners:
+        q = [quantize_unit((v[c] - box_min[c]) / box_size[c]) if box_size[c] > 0.0 else 0 for c in range(0, 3)]
+        vertex_data = struct.pack('HHHH', q[0], q[1], q[2], 0)
+        vertex_data += struct.pack('I', quantize_snorm10(v[3]) | (quantize_snorm10(v[4]) << 10) | (quantize_snorm10(v[5]) << 20))
+        vertex_data += struct.pack('BBBB', v[6], v[7], v[8], v[9])
+        vertex_data += struct.pack('ee', v[10], v[11])
+        soup_count += 1
+        if vertex_data not in mesh_vertices:
+            mesh_vertices[vertex_data] = len(mesh_vertices)
+            data += vertex_data
+            vertex_count += 1
+        elements.append(mesh_vertices[vertex_data])
+
+    index += struct.pack('I', vertex_count)  # vertex_end
+    index += struct.pack('I', element_begin)  # element_begin
+    index += struct.pack('I', len(elements))  # element_end
+
+if max([0] + elements) < 0x10000:
+    element_magic = b'e16.'
+    element_data = struct.pack(str(len(elements)) + 'H', *elements)
+else:
+    element_magic = b'e32.'
+    element_data = struct.pack(str(len(elements)) + 'I', *elements)
+
+# same chunks (in the same order) as export-meshes.py:
+out = open(outfile, 'wb')
+for magic, chunk in [(b'qpnc', data), (b'qnt0', quantization), (element_magic, element_data), (b'str0', strings), (b'idx1', index)]:
+    out.write(struct.pack('4s', magic))
+    out.write(struct.pack('I', len(chunk)))
+    out.write(chunk)
+wrote = out.tell()
+out.close()
+
+print("Wrote " + str(wrote) + " bytes (" + str(vertex_count) + " vertices of 20 bytes; " + str(
+    len(pnct)) + " bytes of vertex data in '" + infile + "' -> " + str(len(data)) + ") to '" + outfile + "'")
+print("Merged " + str(soup_count) + " vertices into " + str(vertex_count) + " unique vertices.")
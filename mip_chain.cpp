@@ -0,0 +1,129 @@
+#include "mip_chain.hpp"
+
+#include "load_save_png.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+void build_mip_chain(std::string const &png_filename, MipChain *mips)
+{
+    glm::uvec2 size;
+    std::vector<glm::u8vec4> data;
+    load_png(png_filename, &size, &data, LowerLeftOrigin);
+    build_mip_chain(size, data, mips);
+}
+
+void build_mip_chain(glm::uvec2 size, std::vector<glm::u8vec4> const &data, MipChain *mips)
+{
+    assert(data.size() == size_t(size.x) * size.y);
+
+    std::vector<glm::uvec2> sizes = mip_level_sizes(size);
+    std::vector<size_t> offsets;
+    size_t total = 0;
+    for (auto const &s : sizes) {
+        offsets.emplace_back(total);
+        total += size_t(s.x) * s.y * 4;
+    }
+    mips->file.reset();
+    mips->storage.resize(total);
+    std::copy(reinterpret_cast<uint8_t const *>(data.data()),
+              reinterpret_cast<uint8_t const *>(data.data()) + data.size() * 4, mips->storage.begin());
+
+    for (uint32_t l = 1; l < sizes.size(); ++l) {
+        glm::uvec2 src_size = sizes[l - 1];
+        glm::uvec2 dst_size = sizes[l];
+        uint8_t const *src = mips->storage.data() + offsets[l - 1];
+        uint8_t *dst = mips->storage.data() + offsets[l];
+        for (uint32_t y = 0; y < dst_size.y; ++y) {
+            uint8_t const *row0 = src + size_t(std::min(2 * y, src_size.y - 1)) * src_size.x * 4;
+            uint8_t const *row1 = src + size_t(std::min(2 * y + 1, src_size.y - 1)) * src_size.x * 4;
+            for (uint32_t x = 0; x < dst_size.x; ++x) {
+                uint32_t x0 = std::min(2 * x, src_size.x - 1) * 4;
+                uint32_t x1 = std::min(2 * x + 1, src_size.x - 1) * 4;
+                for (uint32_t c = 0; c < 4; ++c) {
+                    *(dst++) = uint8_t((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                }
+            }
+        }
+    }
+
+    mips->levels.clear();
+    for (uint32_t l = 0; l < sizes.size(); ++l) {
+        MipChain::Level level;
+        level.size = sizes[l];
+        level.pixels = mips->storage.data() + offsets[l];
+        mips->levels.emplace_back(level);
+    }
+}
+
+void resample_mip_chain(MipChain const &mips, glm::uvec2 size, std::vector<glm::u8vec4> *pixels)
+{
+    assert(!mips.levels.empty() && size.x > 0 && size.y > 0);
+    MipChain::Level const *from = &mips.levels[0];
+    for (auto const &level : mips.levels) {
+        if (level.size.x < size.x || level.size.y < size.y) break;
+        from = &level;
+    }
+
+    pixels->resize(size_t(size.x) * size.y);
+    glm::u8vec4 *to = pixels->data();
+    //(pixel centers of the output, in texels of 'from')
+    glm::vec2 scale = glm::vec2(from->size) / glm::vec2(size);
+    for (uint32_t y = 0; y < size.y; ++y) {
+        float fy = std::min(std::max((y + 0.5f) * scale.y - 0.5f, 0.0f), float(from->size.y - 1));
+        uint32_t y0 = uint32_t(fy);
+        uint32_t y1 = std::min(y0 + 1, from->size.y - 1);
+        float ty = fy - y0;
+        for (uint32_t x = 0; x < size.x; ++x) {
+            float fx = std::min(std::max((x + 0.5f) * scale.x - 0.5f, 0.0f), float(from->size.x - 1));
+            uint32_t x0 = uint32_t(fx);
+            uint32_t x1 = std::min(x0 + 1, from->size.x - 1);
+            float tx = fx - x0;
+            uint8_t const *p00 = from->pixels + 4 * (size_t(y0) * from->size.x + x0);
+            uint8_t const *p10 = from->pixels + 4 * (size_t(y0) * from->size.x + x1);
+            uint8_t const *p01 = from->pixels + 4 * (size_t(y1) * from->size.x + x0);
+            uint8_t const *p11 = from->pixels + 4 * (size_t(y1) * from->size.x + x1);
+            for (uint32_t c = 0; c < 4; ++c) {
+                float v = (p00[c] * (1.0f - tx) + p10[c] * tx) * (1.0f - ty) + (p01[c] * (1.0f - tx) + p11[c] * tx) * ty;
+                (*to)[c] = uint8_t(std::min(255.0f, v + 0.5f));
+            }
+            ++to;
+        }
+    }
+}
+
+std::vector<glm::uvec2> mip_level_sizes(glm::uvec2 size)
+{
+    std::vector<glm::uvec2> sizes;
+    sizes.emplace_back(size);
+    while (size.x > 1 || size.y > 1) {
+        size = glm::uvec2(std::max(1U, size.x / 2), std::max(1U, size.y / 2));
+        sizes.emplace_back(size);
+    }
+    return sizes;
+}
+
+uint64_t fnv1a_64(uint8_t const *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t hash_file(std::string const &filename)
+{
+    MappedFile file(filename);
+    return fnv1a_64(file.data(), file.size());
+}
+
+void write_chunk(std::ostream &to, std::string const &magic, void const *data, size_t size)
+{
+    assert(magic.size() == 4);
+    uint32_t size32 = uint32_t(size);
+    assert(size32 == size);
+    to.write(magic.data(), 4);
+    to.write(reinterpret_cast<char const *>(&size32), 4);
+    to.write(reinterpret_cast<char const *>(data), size);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//Image mip chains, shared by load_texture (at runtime) and compress_textures (offline).
+// (no OpenGL calls here)
+
+//pixels of each level of a mip chain, pointing into either a mapped file or 'storage':
+struct MipChain
+{
+    struct Level
+    {
+        glm::uvec2 size;
+        uint8_t const *pixels = nullptr; //RGBA8, rows bottom-to-top
+    };
+    std::vector<Level> levels;
+
+    std::unique_ptr<MappedFile> file;
+    std::vector<uint8_t> storage;
+};
+
+//decode a png and build its full mip chain (down to 1x1) with a 2x2 box filter, like glGenerateMipmap:
+//NOTE: will throw if the png can't be read
+void build_mip_chain(std::string const &png_filename, MipChain *mips);
+
+//build the full mip chain of an image (rows bottom-to-top) in the same way:
+void build_mip_chain(glm::uvec2 size, std::vector<glm::u8vec4> const &pixels, MipChain *mips);
+
+//resample the level of 'mips' nearest above 'size' (or level 0, if none is) to 'size', bilinearly:
+// (so each output pixel blends texels from at most a 2x2 area of the original)
+void resample_mip_chain(MipChain const &mips, glm::uvec2 size, std::vector<glm::u8vec4> *pixels);
+
+//sizes of all levels of a full mip chain:
+std::vector<glm::uvec2> mip_level_sizes(glm::uvec2 size);
+
+//64-bit FNV-1a hash, used to tell whether a cache built from a file is still current:
+uint64_t fnv1a_64(uint8_t const *data, size_t size);
+
+//hash of a file's contents:
+//NOTE: will throw if the file can't be read
+uint64_t hash_file(std::string const &filename);
+
+//write a chunk that read_chunk() can read back:
+void write_chunk(std::ostream &to, std::string const &magic, void const *data, size_t size);
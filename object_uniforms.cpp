@@ -0,0 +1,35 @@
+#include "object_uniforms.hpp"
+
+#include <initializer_list>
+
+char const * const ObjectUniforms::glsl =
+    "layout(std140) uniform Object {\n"
+    "	mat4 object_to_clip;\n"
+    "	mat4 object_to_light;\n"
+    "	mat3 normal_to_light;\n"
+    "};\n";
+
+//(DrawSlot is bound to DrawSlotLocation by compile_program)
+std::string const ObjectUniforms::glsl_multidraw =
+    "struct ObjectData {\n"
+    "	mat4 object_to_clip;\n"
+    "	mat4 object_to_light;\n"
+    "	mat3 normal_to_light;\n"
+    "};\n"
+    "layout(std140) uniform Objects {\n"
+    "	ObjectData objects[" + std::to_string(MultiDrawSlots) + "];\n"
+    "};\n"
+    "in uint DrawSlot;\n"
+    "#define object_to_clip (objects[DrawSlot].object_to_clip)\n"
+    "#define object_to_light (objects[DrawSlot].object_to_light)\n"
+    "#define normal_to_light (objects[DrawSlot].normal_to_light)\n";
+
+void ObjectUniforms::bind_program(GLuint program)
+{
+    for (char const *name : {"Object", "Objects"}) {
+        GLuint index = glGetUniformBlockIndex(program, name);
+        if (index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program, index, Binding);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+
+//ObjectUniforms describes the per-object matrices that Scene::draw streams into a uniform buffer.
+// Programs paste ObjectUniforms::glsl into their vertex shader and call ObjectUniforms::bind_program after linking;
+// Scene then binds each object's slice of its buffer with glBindBufferRange instead of setting uniforms.
+struct ObjectUniforms
+{
+    //CPU-side copy of the block; layout matches the std140 "Object" block in 'glsl':
+    struct Data
+    {
+        glm::mat4 object_to_clip;
+        glm::mat4 object_to_light;
+        glm::vec4 normal_to_light[3]; //mat3 columns (std140 pads each to a vec4)
+    };
+    static_assert(sizeof(Data) == 176, "ObjectUniforms::Data must match std140 layout of the Object block.");
+
+    //declaration of the "Object" block:
+    static char const * const glsl;
+
+    //multi-draw programs paste ObjectUniforms::glsl_multidraw instead, which declares an "Objects" block holding an
+    // array of MultiDrawSlots blocks, indexed by the "DrawSlot" vertex attribute (see GeometryArena::draw_slot).
+    // It #defines object_to_clip etc. as this vertex's entry, so shader code is the same as with 'glsl':
+    // (MultiDrawSlots * sizeof(Data) fits in the smallest GL_MAX_UNIFORM_BLOCK_SIZE allowed, 16K)
+    enum: uint32_t
+    {
+        MultiDrawSlots = 64
+    };
+    static std::string const glsl_multidraw; //(built from MultiDrawSlots, so the two can't disagree)
+
+    //uniform buffer binding point the block is attached to:
+    // (FrameUniforms uses binding 0)
+    enum: GLuint
+    {
+        Binding = 1
+    };
+
+    //attach a program's "Object" (or "Objects") block (if it has one) to Binding:
+    static void bind_program(GLuint program);
+};
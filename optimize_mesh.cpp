@@ -0,0 +1,180 @@
+#include "optimize_mesh.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cassert>
+
+uint32_t count_vertex_cache_misses(uint32_t const *elements, uint32_t element_count, uint32_t vertex_count)
+{
+  //FIFO cache; a vertex is in the cache if it entered within the last VertexCacheSize misses:
+  std::vector<uint32_t> entered(vertex_count, 0);
+  uint32_t misses = 0;
+  for (uint32_t i = 0; i < element_count; ++i) {
+    uint32_t v = elements[i];
+    assert(v < vertex_count);
+    if (entered[v] == 0 || misses + 1 - entered[v] > VertexCacheSize) {
+      misses += 1;
+      entered[v] = misses;
+    }
+  }
+  return misses;
+}
+
+//scoring constants from the paper:
+static float const CacheDecayPower = 1.5f;
+static float const LastTriScore = 0.75f;
+static float const ValenceBoostScale = 2.0f;
+static float const ValenceBoostPower = 0.5f;
+
+static float vertex_score(int32_t cache_position, uint32_t remaining)
+{
+  if (remaining == 0) return -1.0f; //no triangles left to draw with this vertex
+
+  float score = 0.0f;
+  if (cache_position < 0) {
+    //not in cache
+  }
+  else if (cache_position < 3) {
+    //used by the triangle just drawn; fixed score to avoid favoring one edge:
+    score = LastTriScore;
+  }
+  else {
+    float scale = 1.0f / (VertexCacheSize - 3);
+    score = std::pow(1.0f - (cache_position - 3) * scale, CacheDecayPower);
+  }
+
+  //boost vertices with few triangles left, so they get finished off instead of leaving stragglers:
+  score += ValenceBoostScale * std::pow(float(remaining), -ValenceBoostPower);
+  return score;
+}
+
+void optimize_vertex_cache(uint32_t *elements, uint32_t element_count, uint32_t vertex_count)
+{
+  assert(element_count % 3 == 0);
+  uint32_t triangle_count = element_count / 3;
+  if (triangle_count == 0) return;
+
+  //triangles using each vertex (vertex v's are triangles[offsets[v], offsets[v] + remaining[v])):
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  for (uint32_t i = 0; i < element_count; ++i) {
+    assert(elements[i] < vertex_count);
+    remaining[elements[i]] += 1;
+  }
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for (uint32_t v = 0; v < vertex_count; ++v) {
+    offsets[v + 1] = offsets[v] + remaining[v];
+  }
+  std::vector<uint32_t> triangles(element_count);
+  {
+    std::vector<uint32_t> filled(vertex_count, 0);
+    for (uint32_t i = 0; i < element_count; ++i) {
+      uint32_t v = elements[i];
+      triangles[offsets[v] + filled[v]++] = i / 3;
+    }
+  }
+
+  std::vector<int32_t> cache_position(vertex_count, -1);
+  std::vector<float> score(vertex_count);
+  for (uint32_t v = 0; v < vertex_count; ++v) {
+    score[v] = vertex_score(-1, remaining[v]);
+  }
+  std::vector<float> triangle_score(triangle_count);
+  for (uint32_t t = 0; t < triangle_count; ++t) {
+    triangle_score[t] = score[elements[3 * t + 0]] + score[elements[3 * t + 1]] + score[elements[3 * t + 2]];
+  }
+
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<uint32_t> output;
+  output.reserve(element_count);
+
+  std::vector<uint32_t> cache, next_cache;
+  cache.reserve(VertexCacheSize + 3);
+  next_cache.reserve(VertexCacheSize + 3);
+
+  uint32_t best = -1U;
+  uint32_t scan = 0; //triangles before this are all emitted
+  for (uint32_t drawn = 0; drawn < triangle_count; ++drawn) {
+    if (best == -1U) {
+      //nothing adjacent to the cache left; start again from the best remaining triangle:
+      while (emitted[scan]) ++scan;
+      best = scan;
+      for (uint32_t t = scan + 1; t < triangle_count; ++t) {
+        if (!emitted[t] && triangle_score[t] > triangle_score[best]) best = t;
+      }
+    }
+
+    //emit it:
+    uint32_t const *tri = elements + 3 * best;
+    emitted[best] = true;
+    next_cache.clear();
+    for (uint32_t c = 0; c < 3; ++c) {
+      uint32_t v = tri[c];
+      output.emplace_back(v);
+      next_cache.emplace_back(v);
+
+      //remove triangle from vertex's list:
+      uint32_t *list = triangles.data() + offsets[v];
+      uint32_t *last = list + remaining[v] - 1;
+      *std::find(list, last + 1, best) = *last;
+      *last = best;
+      remaining[v] -= 1;
+    }
+
+    //triangle's vertices go to the front of the cache:
+    for (uint32_t v : cache) {
+      if (v != tri[0] && v != tri[1] && v != tri[2]) next_cache.emplace_back(v);
+    }
+    for (uint32_t i = 0; i < next_cache.size(); ++i) {
+      cache_position[next_cache[i]] = (i < VertexCacheSize ? int32_t(i) : -1);
+    }
+
+    //rescore vertices whose cache position changed and the triangles that use them:
+    for (uint32_t v : next_cache) {
+      score[v] = vertex_score(cache_position[v], remaining[v]);
+    }
+    best = -1U;
+    float best_score = -1.0f;
+    for (uint32_t v : next_cache) {
+      for (uint32_t i = 0; i < remaining[v]; ++i) {
+        uint32_t t = triangles[offsets[v] + i];
+        float s = score[elements[3 * t + 0]] + score[elements[3 * t + 1]] + score[elements[3 * t + 2]];
+        triangle_score[t] = s;
+        if (s > best_score) {
+          best_score = s;
+          best = t;
+        }
+      }
+    }
+
+    if (next_cache.size() > VertexCacheSize) next_cache.resize(VertexCacheSize);
+    cache.swap(next_cache);
+  }
+
+  assert(output.size() == element_count);
+  std::copy(output.begin(), output.end(), elements);
+}
+
+void optimize_vertex_fetch(uint32_t *elements, uint32_t element_count,
+                           uint8_t *vertices, uint32_t vertex_count, uint32_t vertex_size)
+{
+  std::vector<uint32_t> remap(vertex_count, -1U);
+  uint32_t next = 0;
+  for (uint32_t i = 0; i < element_count; ++i) {
+    uint32_t &v = elements[i];
+    assert(v < vertex_count);
+    if (remap[v] == -1U) remap[v] = next++;
+    v = remap[v];
+  }
+  for (uint32_t v = 0; v < vertex_count; ++v) {
+    if (remap[v] == -1U) remap[v] = next++;
+  }
+  assert(next == vertex_count);
+
+  std::vector<uint8_t> reordered(size_t(vertex_count) * vertex_size);
+  for (uint32_t v = 0; v < vertex_count; ++v) {
+    memcpy(&reordered[size_t(remap[v]) * vertex_size], &vertices[size_t(v) * vertex_size], vertex_size);
+  }
+  memcpy(vertices, reordered.data(), reordered.size());
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+//Load-time reordering of indexed triangle meshes for the GPU:
+// (elements are relative to the mesh's first vertex; element_count must be a multiple of three)
+
+//size of the FIFO vertex cache assumed by these functions:
+enum: uint32_t
+{
+    VertexCacheSize = 32
+};
+
+//count vertex cache misses when drawing triangles in the given order:
+// (average cache miss ratio, "ACMR", is misses / triangles)
+uint32_t count_vertex_cache_misses(uint32_t const *elements, uint32_t element_count, uint32_t vertex_count);
+
+//reorder triangles so that recently-used vertices are reused while still in the post-transform cache:
+// (Forsyth's "Linear-Speed Vertex Cache Optimisation")
+void optimize_vertex_cache(uint32_t *elements, uint32_t element_count, uint32_t vertex_count);
+
+//reorder vertices (each vertex_size bytes) into the order triangles first use them, updating elements to match:
+// (vertices not used by any triangle are moved to the end)
+void optimize_vertex_fetch(uint32_t *elements, uint32_t element_count,
+                           uint8_t *vertices, uint32_t vertex_count, uint32_t vertex_size);
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
 #include <stdexcept>
 #include <cassert>
 
@@ -35,3 +36,17 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector<T> *_t
         throw std::runtime_error("Failed to read chunk data.");
     }
 }
+
+//magic of the next chunk in a stream (without consuming it), or "" if there are no more chunks:
+inline std::string peek_chunk_magic(std::istream &from)
+{
+    std::streampos at = from.tellg();
+    char magic[4];
+    if (!from.read(magic, 4)) {
+        from.clear();
+        from.seekg(at);
+        return "";
+    }
+    from.seekg(at);
+    return std::string(magic, 4);
+}
@@ -0,0 +1,168 @@
+#include "s3tc.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+size_t s3tc_level_bytes(S3TCFormat format, glm::uvec2 size)
+{
+    size_t blocks = size_t((size.x + 3) / 4) * ((size.y + 3) / 4);
+    return blocks * (format == BC1 ? 8 : 16);
+}
+
+S3TCFormat choose_s3tc_format(MipChain const &mips)
+{
+    for (auto const &level : mips.levels) {
+        for (size_t i = 0; i < size_t(level.size.x) * level.size.y; ++i) {
+            if (level.pixels[4 * i + 3] != 0xff) return BC3;
+        }
+    }
+    return BC1;
+}
+
+static uint16_t pack_565(float r, float g, float b)
+{
+    auto quantize = [](float v, uint32_t max) -> uint32_t
+    {
+        return uint32_t(std::round(std::min(std::max(v, 0.0f), 255.0f) * max / 255.0f));
+    };
+    return uint16_t((quantize(r, 31) << 11) | (quantize(g, 63) << 5) | quantize(b, 31));
+}
+
+static void unpack_565(uint16_t c, int32_t rgb[3])
+{
+    //(replicate high bits into low bits, as decoders do)
+    uint32_t r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    rgb[0] = int32_t((r << 3) | (r >> 2));
+    rgb[1] = int32_t((g << 2) | (g >> 4));
+    rgb[2] = int32_t((b << 3) | (b >> 2));
+}
+
+//color half of a block: endpoints on the principal axis of the block's colors ("range fit"), four-color mode:
+static void compress_color(uint8_t const (&px)[16][4], uint8_t *out)
+{
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (uint32_t i = 0; i < 16; ++i) {
+        for (uint32_t c = 0; c < 3; ++c) mean[c] += px[i][c] / 16.0f;
+    }
+    float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}; //rr rg rb gg gb bb
+    for (uint32_t i = 0; i < 16; ++i) {
+        float d[3] = {px[i][0] - mean[0], px[i][1] - mean[1], px[i][2] - mean[2]};
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+
+    //principal axis by power iteration:
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (uint32_t iter = 0; iter < 8; ++iter) {
+        float next[3] = {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+        };
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f) break; //(flat block; any axis will do)
+        for (uint32_t c = 0; c < 3; ++c) axis[c] = next[c] / length;
+    }
+
+    float lo = 0.0f, hi = 0.0f;
+    for (uint32_t i = 0; i < 16; ++i) {
+        float t = (px[i][0] - mean[0]) * axis[0] + (px[i][1] - mean[1]) * axis[1] + (px[i][2] - mean[2]) * axis[2];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+    uint16_t c0 = pack_565(mean[0] + axis[0] * hi, mean[1] + axis[1] * hi, mean[2] + axis[2] * hi);
+    uint16_t c1 = pack_565(mean[0] + axis[0] * lo, mean[1] + axis[1] * lo, mean[2] + axis[2] * lo);
+    if (c0 < c1) std::swap(c0, c1); //(c0 > c1 selects four-color mode)
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int32_t palette[4][3];
+        unpack_565(c0, palette[0]);
+        unpack_565(c1, palette[1]);
+        for (uint32_t c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (uint32_t i = 0; i < 16; ++i) {
+            uint32_t best = 0;
+            int32_t best_dis2 = 0x7fffffff;
+            for (uint32_t p = 0; p < 4; ++p) {
+                int32_t dr = px[i][0] - palette[p][0], dg = px[i][1] - palette[p][1], db = px[i][2] - palette[p][2];
+                int32_t dis2 = dr * dr + dg * dg + db * db;
+                if (dis2 < best_dis2) {
+                    best_dis2 = dis2;
+                    best = p;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+
+    out[0] = uint8_t(c0); out[1] = uint8_t(c0 >> 8);
+    out[2] = uint8_t(c1); out[3] = uint8_t(c1 >> 8);
+    for (uint32_t b = 0; b < 4; ++b) out[4 + b] = uint8_t(indices >> (8 * b));
+}
+
+//alpha half of a BC3 block: min/max endpoints, eight-value mode:
+static void compress_alpha(uint8_t const (&px)[16][4], uint8_t *out)
+{
+    uint8_t a0 = 0, a1 = 255;
+    for (uint32_t i = 0; i < 16; ++i) {
+        a0 = std::max(a0, px[i][3]);
+        a1 = std::min(a1, px[i][3]);
+    }
+
+    uint64_t indices = 0;
+    if (a0 != a1) {
+        int32_t palette[8];
+        palette[0] = a0;
+        palette[1] = a1;
+        for (int32_t k = 1; k < 7; ++k) {
+            palette[1 + k] = ((7 - k) * a0 + k * a1) / 7;
+        }
+        for (uint32_t i = 0; i < 16; ++i) {
+            uint64_t best = 0;
+            int32_t best_dis = 256;
+            for (uint32_t p = 0; p < 8; ++p) {
+                int32_t dis = std::abs(px[i][3] - palette[p]);
+                if (dis < best_dis) {
+                    best_dis = dis;
+                    best = p;
+                }
+            }
+            indices |= best << (3 * i);
+        }
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    for (uint32_t b = 0; b < 6; ++b) out[2 + b] = uint8_t(indices >> (8 * b));
+}
+
+std::vector<uint8_t> compress_s3tc(MipChain::Level const &level, S3TCFormat format)
+{
+    assert(format == BC1 || format == BC3);
+    std::vector<uint8_t> blocks(s3tc_level_bytes(format, level.size));
+    uint8_t *out = blocks.data();
+
+    for (uint32_t by = 0; by < level.size.y; by += 4) {
+        for (uint32_t bx = 0; bx < level.size.x; bx += 4) {
+            uint8_t px[16][4];
+            for (uint32_t i = 0; i < 16; ++i) {
+                uint32_t x = std::min(bx + i % 4, level.size.x - 1);
+                uint32_t y = std::min(by + i / 4, level.size.y - 1);
+                uint8_t const *p = level.pixels + 4 * (size_t(y) * level.size.x + x);
+                std::copy(p, p + 4, px[i]);
+            }
+            if (format == BC3) {
+                compress_alpha(px, out);
+                out += 8;
+            }
+            compress_color(px, out);
+            out += 8;
+        }
+    }
+    assert(out == blocks.data() + blocks.size());
+    return blocks;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "mip_chain.hpp"
+
+#include <vector>
+#include <cstdint>
+
+//S3TC ("BC1"/"BC3") block compression, used by compress_textures to make "[png].s3tc" files for load_texture.
+//
+//A .s3tc file is a chunk file:
+// "s3tc": one S3TCInfo
+// "blks": level 0 blocks (block rows bottom-to-top, like the png's pixel rows), then one more "blks" chunk per level
+
+//formats (these are the GL_COMPRESSED_*_S3TC_* values passed to glCompressedTexImage2D):
+enum S3TCFormat: uint32_t
+{
+    BC1 = 0x83F0, //GL_COMPRESSED_RGB_S3TC_DXT1_EXT: 8 bytes per 4x4 block, no alpha
+    BC3 = 0x83F3, //GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: 16 bytes per 4x4 block, BC1 color + interpolated alpha
+};
+
+struct S3TCInfo
+{
+    uint64_t source_hash = 0; //fnv1a_64 of the png's bytes
+    uint32_t version = 0;
+    uint32_t format = 0; //S3TCFormat
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levels = 0;
+    uint32_t padding = 0;
+};
+static_assert(sizeof(S3TCInfo) == 32, "S3TCInfo is packed");
+
+//bump when the file layout changes:
+enum: uint32_t
+{
+    S3TCVersion = 1
+};
+
+//bytes of compressed data for one level:
+size_t s3tc_level_bytes(S3TCFormat format, glm::uvec2 size);
+
+//BC1 if every pixel of every level is opaque, BC3 otherwise:
+S3TCFormat choose_s3tc_format(MipChain const &mips);
+
+//compress one level (edge blocks of levels not a multiple of 4 in size are padded by repeating edge pixels):
+std::vector<uint8_t> compress_s3tc(MipChain::Level const &level, S3TCFormat format);
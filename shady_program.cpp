@@ -1,17 +1,26 @@
 #include "shady_program.hpp"
 
 #include "compile_program.hpp"
+#include "frame_uniforms.hpp"
+#include "object_uniforms.hpp"
 #include "gl_errors.hpp"
 
-ShadyProgram::ShadyProgram()
+ShadyProgram::ShadyProgram(bool instanced, bool multidraw)
 {
     program = compile_program(
-        "#version 330\n"
-        "uniform mat4 object_to_clip;\n"
-        "uniform mat4 object_to_light;\n"
-        "uniform mat3 normal_to_light;\n"
-        "uniform mat4 light_to_spot;\n"
-        "uniform mat4 light_to_target;\n"
+        std::string("#version 330\n")
+        + (instanced ? "#define INSTANCED\n" : "")
+        + (multidraw ? "#define MULTIDRAW\n" : "")
+        + FrameUniforms::glsl +
+        "#ifdef INSTANCED\n"
+        "uniform mat4 light_to_clip;\n"
+        "layout(location=4) in mat4 InstanceToLight;\n" //per-instance (see Scene::InstanceToLightLocation)
+        "layout(location=8) in mat3 InstanceNormalToLight;\n"
+        "#elif defined(MULTIDRAW)\n"
+        + ObjectUniforms::glsl_multidraw +
+        "#else\n"
+        + ObjectUniforms::glsl +
+        "#endif\n"
         "layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
         "in vec3 Normal;\n"
         "in vec4 Color;\n"
@@ -23,30 +32,26 @@ ShadyProgram::ShadyProgram()
         "out vec4 spotPosition;\n"
         "out vec4 targetPosition;\n"
         "void main() {\n"
+        "#ifdef INSTANCED\n"
+        "	position = InstanceToLight * Position;\n"
+        "	gl_Position = light_to_clip * position;\n"
+        "	normal = InstanceNormalToLight * Normal;\n"
+        "#else\n"
         "	gl_Position = object_to_clip * Position;\n"
         "	position = object_to_light * Position;\n"
+        "	normal = normal_to_light * Normal;\n"
+        "#endif\n"
         "	spotPosition = light_to_spot * vec4(position.xyz, 1.0);\n"
         "	targetPosition = light_to_target * vec4(position.xyz, 1.0);\n"
-        "	normal = normal_to_light * Normal;\n"
         "	color = Color;\n"
         "	texCoord = TexCoord;\n"
         "}\n",
-        "#version 330\n"
-        "uniform vec3 sun_direction;\n"
-        "uniform vec3 sun_color;\n"
-        "uniform vec3 sky_direction;\n"
-        "uniform vec3 sky_color;\n"
-        "uniform vec3 spot_position;\n"
-        "uniform vec3 spot_direction;\n"
-        "uniform vec3 target_position;\n"
-        "uniform vec3 target_direction;\n"
-        "uniform vec3 spot_color;\n"
-        "uniform vec2 spot_outer_inner;\n"
-        "uniform vec2 screen_size;\n"
+        std::string("#version 330\n")
+        + FrameUniforms::glsl +
         "uniform sampler2D tex;\n"
         "uniform sampler2DShadow spot_depth_tex;\n"
         "uniform sampler2DShadow target_depth_tex;\n"
-        "uniform sampler2D gateway_tex;\n"
+        "uniform sampler2DArray gateway_tex;\n"
         "in vec4 position;\n"
         "in vec3 normal;\n"
         "in vec4 color;\n"
@@ -84,7 +89,7 @@ ShadyProgram::ShadyProgram()
         "	if (target_tex_coord.x > (1.f/3.f) && target_tex_coord.y > (1.f/3.f) &&\n"
         "       target_tex_coord.x < (2.f/3.f) && target_tex_coord.y < (2.f/3.f) &&\n"
         "       at_front > 0.0f) {\n"
-        "		fragColor = texture(gateway_tex, target_tex_coord.xy);\n"
+        "		fragColor = texture(gateway_tex, vec3(target_tex_coord.xy, gateway_layer));\n"
         "	} else {\n"
         "               fragColor = texture(tex, texCoord) * vec4(color.rgb * total_light, color.a);\n"
         "	}\n"
@@ -92,27 +97,11 @@ ShadyProgram::ShadyProgram()
         "}\n"
     );
 
-    object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
-    object_to_light_mat4 = glGetUniformLocation(program, "object_to_light");
-    normal_to_light_mat3 = glGetUniformLocation(program, "normal_to_light");
-
-    sun_direction_vec3 = glGetUniformLocation(program, "sun_direction");
-    sun_color_vec3 = glGetUniformLocation(program, "sun_color");
-    sky_direction_vec3 = glGetUniformLocation(program, "sky_direction");
-    sky_color_vec3 = glGetUniformLocation(program, "sky_color");
-
-    spot_position_vec3 = glGetUniformLocation(program, "spot_position");
-    spot_direction_vec3 = glGetUniformLocation(program, "spot_direction");
-    spot_color_vec3 = glGetUniformLocation(program, "spot_color");
-    spot_outer_inner_vec2 = glGetUniformLocation(program, "spot_outer_inner");
-
-    target_position_vec3 = glGetUniformLocation(program, "target_position");
-    target_direction_vec3 = glGetUniformLocation(program, "target_direction");
-
-    screen_size_vec2 = glGetUniformLocation(program, "screen_size");
+    light_to_clip_mat4 = glGetUniformLocation(program, "light_to_clip");
 
-    light_to_spot_mat4 = glGetUniformLocation(program, "light_to_spot");
-    light_to_target_mat4 = glGetUniformLocation(program, "light_to_target");
+    //lighting comes from the per-frame uniform block, object matrices from the per-object block:
+    FrameUniforms::bind_program(program);
+    ObjectUniforms::bind_program(program);
 
     glUseProgram(program);
 
@@ -125,8 +114,8 @@ ShadyProgram::ShadyProgram()
     GLuint target_depth_tex_sampler2D = glGetUniformLocation(program, "target_depth_tex");
     glUniform1i(target_depth_tex_sampler2D, 2);
 
-    GLuint gateway_tex_sampler2D = glGetUniformLocation(program, "gateway_tex");
-    glUniform1i(gateway_tex_sampler2D, 3);
+    GLuint gateway_tex_sampler2DArray = glGetUniformLocation(program, "gateway_tex");
+    glUniform1i(gateway_tex_sampler2DArray, 3);
 
     glUseProgram(0);
 
@@ -137,3 +126,13 @@ Load<ShadyProgram> shady_program(LoadTagInit, []()
 {
     return new ShadyProgram();
 });
+
+Load<ShadyProgram> shady_program_instanced(LoadTagInit, []()
+{
+    return new ShadyProgram(true);
+});
+
+Load<ShadyProgram> shady_program_multidraw(LoadTagInit, []()
+{
+    return new ShadyProgram(false, true);
+});
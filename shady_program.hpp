@@ -8,32 +8,20 @@ struct ShadyProgram
 	GLuint program = 0;
 
 	//uniform locations:
-	GLuint object_to_clip_mat4 = -1U;
-	GLuint object_to_light_mat4 = -1U;
-	GLuint normal_to_light_mat3 = -1U;
+	GLuint light_to_clip_mat4 = -1U; //(instanced variant only: object matrices come from per-instance attributes)
 
-	GLuint sun_direction_vec3 = -1U; //direction *to* sun
-	GLuint sun_color_vec3 = -1U;
-	GLuint sky_direction_vec3 = -1U; //direction *to* sky
-	GLuint sky_color_vec3 = -1U;
+	//(otherwise, object matrices are read from the per-object uniform block -- or, for the multi-draw variant,
+	// the vertex's entry in the "Objects" array; see object_uniforms.hpp)
 
-	GLuint spot_position_vec3 = -1U;
-	GLuint spot_direction_vec3 = -1U; //direction *from* spotlight
-    GLuint target_position_vec3 = -1U;
-    GLuint target_direction_vec3 = -1U; //direction *from* spotlight
-	GLuint spot_color_vec3 = -1U;
-	GLuint spot_outer_inner_vec2 =
-		-1U; //color fades from zero to one as dot(spot_direction, spot_to_position) varies from outer_inner.x to outer_inner.y
-	GLuint light_to_spot_mat4 = -1U; //projects from lighting space (/world space) to spot light depth map space
-    GLuint light_to_target_mat4 = -1U;
-
-	GLuint screen_size_vec2 = -1U;
+	//(lights and the spot / target view projections are read from the per-frame uniform block; see frame_uniforms.hpp)
 
 	//textures:
 	//texture0 - texture for the surface
 	//texture1 - texture for spot light shadow map
 
-	ShadyProgram();
+	ShadyProgram(bool instanced = false, bool multidraw = false);
 };
 
 extern Load<ShadyProgram> shady_program;
+extern Load<ShadyProgram> shady_program_instanced; //draws many objects per call; see Scene::Object::ProgramInfo::instanced_program
+extern Load<ShadyProgram> shady_program_multidraw; //draws many meshes per call; see Scene::Object::ProgramInfo::multidraw_program
@@ -1,16 +1,16 @@
 #include "texture_program.hpp"
 
 #include "compile_program.hpp"
+#include "frame_uniforms.hpp"
+#include "object_uniforms.hpp"
 #include "gl_errors.hpp"
 
 TextureProgram::TextureProgram()
 {
     program = compile_program(
-        "#version 330\n"
-        "uniform mat4 object_to_clip;\n"
-        "uniform mat4 object_to_light;\n"
-        "uniform mat3 normal_to_light;\n"
-        "uniform mat4 light_to_spot;\n"
+        std::string("#version 330\n")
+        + FrameUniforms::glsl
+        + ObjectUniforms::glsl +
         "layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
         "in vec3 Normal;\n"
         "in vec4 Color;\n"
@@ -28,15 +28,8 @@ TextureProgram::TextureProgram()
         "	color = Color;\n"
         "	texCoord = TexCoord;\n"
         "}\n",
-        "#version 330\n"
-        "uniform vec3 sun_direction;\n"
-        "uniform vec3 sun_color;\n"
-        "uniform vec3 sky_direction;\n"
-        "uniform vec3 sky_color;\n"
-        "uniform vec3 spot_position;\n"
-        "uniform vec3 spot_direction;\n"
-        "uniform vec3 spot_color;\n"
-        "uniform vec2 spot_outer_inner;\n"
+        std::string("#version 330\n")
+        + FrameUniforms::glsl +
         "uniform sampler2D tex;\n"
         "uniform sampler2DShadow spot_depth_tex;\n"
         "in vec4 position;\n"
@@ -73,21 +66,9 @@ TextureProgram::TextureProgram()
         "}\n"
     );
 
-    object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
-    object_to_light_mat4 = glGetUniformLocation(program, "object_to_light");
-    normal_to_light_mat3 = glGetUniformLocation(program, "normal_to_light");
-
-    sun_direction_vec3 = glGetUniformLocation(program, "sun_direction");
-    sun_color_vec3 = glGetUniformLocation(program, "sun_color");
-    sky_direction_vec3 = glGetUniformLocation(program, "sky_direction");
-    sky_color_vec3 = glGetUniformLocation(program, "sky_color");
-
-    spot_position_vec3 = glGetUniformLocation(program, "spot_position");
-    spot_direction_vec3 = glGetUniformLocation(program, "spot_direction");
-    spot_color_vec3 = glGetUniformLocation(program, "spot_color");
-    spot_outer_inner_vec2 = glGetUniformLocation(program, "spot_outer_inner");
-
-    light_to_spot_mat4 = glGetUniformLocation(program, "light_to_spot");
+    //lighting comes from the per-frame uniform block, object matrices from the per-object block:
+    FrameUniforms::bind_program(program);
+    ObjectUniforms::bind_program(program);
 
     glUseProgram(program);
 
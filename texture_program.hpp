@@ -7,22 +7,8 @@ struct TextureProgram
     //opengl program object:
     GLuint program = 0;
 
-    //uniform locations:
-    GLuint object_to_clip_mat4 = -1U;
-    GLuint object_to_light_mat4 = -1U;
-    GLuint normal_to_light_mat3 = -1U;
-
-    GLuint sun_direction_vec3 = -1U; //direction *to* sun
-    GLuint sun_color_vec3 = -1U;
-    GLuint sky_direction_vec3 = -1U; //direction *to* sky
-    GLuint sky_color_vec3 = -1U;
-
-    GLuint spot_position_vec3 = -1U;
-    GLuint spot_direction_vec3 = -1U; //direction *from* spotlight
-    GLuint spot_color_vec3 = -1U;
-    GLuint spot_outer_inner_vec2 =
-        -1U; //color fades from zero to one as dot(spot_direction, spot_to_position) varies from outer_inner.x to outer_inner.y
-    GLuint light_to_spot_mat4 = -1U; //projects from lighting space (/world space) to spot light depth map space
+    //(object matrices are read from the per-object uniform block; see object_uniforms.hpp)
+    //(lights are read from the per-frame uniform block; see frame_uniforms.hpp)
 
     //textures:
     //texture0 - texture for the surface
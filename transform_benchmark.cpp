@@ -0,0 +1,113 @@
+#include "Scene.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+//transform_benchmark times the per-frame transform pass, Scene::update_world_matrices(), against asking each
+// transform for make_local_to_world() on demand (the way Scene::draw found world matrices before the batch pass).
+// It uses scenes of 10k and 100k transforms (or the counts given on the command line).
+// (it makes no OpenGL calls, so needs no window)
+//e.g.:
+//   transform_benchmark 10000 100000
+
+//make 'count' transforms: with 'fan_out' 0 all are roots (like GameMode's stones); otherwise transform i is a
+// child of transform (i - 1) / fan_out, which makes a tree about log(count) / log(fan_out) deep:
+static std::vector<Scene::Transform *> make_transforms(Scene &scene, uint32_t count, uint32_t fan_out)
+{
+    std::vector<Scene::Transform *> transforms;
+    transforms.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        Scene::Transform *t = scene.new_transform();
+        t->set_position(glm::vec3(float(i % 100), float(i / 100 % 100), float(i / 10000)));
+        if (fan_out != 0 && i > 0) {
+            t->set_parent(transforms[(i - 1) / fan_out]);
+        }
+        transforms.emplace_back(t);
+    }
+    return transforms;
+}
+
+//average milliseconds per frame spent in 'update', after the 'moved' transforms are given a new rotation:
+template<typename F>
+static double time_frames(std::vector<Scene::Transform *> const &transforms, std::vector<uint32_t> const &moved,
+                          uint32_t frames, F const &update)
+{
+    std::chrono::duration<double> total(0.0);
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        glm::quat rotation = glm::angleAxis(0.01f * frame, glm::vec3(0.0f, 0.0f, 1.0f));
+        for (uint32_t i : moved) {
+            transforms[i]->set_rotation(rotation);
+        }
+        auto before = std::chrono::high_resolution_clock::now();
+        update();
+        auto after = std::chrono::high_resolution_clock::now();
+        total += after - before;
+    }
+    return total.count() * 1000.0 / frames;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<uint32_t> counts;
+    for (int a = 1; a < argc; ++a) {
+        counts.emplace_back(uint32_t(std::strtoul(argv[a], nullptr, 10)));
+        if (counts.back() == 0) {
+            std::cerr << "Usage:\n\t./transform_benchmark [count ...]" << std::endl;
+            return 1;
+        }
+    }
+    if (counts.empty()) counts = {10000, 100000};
+
+    //say what the numbers below were measured with:
+    // (glm's matrix code, and whether it was built with optimization, matter more than anything else here)
+    std::cout << "glm " << GLM_VERSION_MAJOR << "." << GLM_VERSION_MINOR << "." << GLM_VERSION_PATCH << "."
+              << GLM_VERSION_REVISION
+#ifdef NDEBUG
+              << ", release build" << std::endl;
+#else
+              << ", debug build (assertions on; build with NDEBUG and optimization for representative numbers)" << std::endl;
+#endif
+
+    volatile float sink = 0.0f; //(keeps the on-demand results from being optimized away)
+
+    for (uint32_t count : counts) {
+        uint32_t frames = std::max(10U, 10000000U / count);
+        for (uint32_t fan_out : {0U, 8U}) {
+            Scene scene;
+            std::vector<Scene::Transform *> transforms = make_transforms(scene, count, fan_out);
+
+            std::vector<uint32_t> all(count);
+            for (uint32_t i = 0; i < count; ++i) all[i] = i;
+            std::vector<uint32_t> some; //(one transform in a hundred, with its descendants)
+            std::mt19937 mt(0x12345678);
+            for (uint32_t i = 0; i < count / 100; ++i) some.emplace_back(mt() % count);
+
+            auto sweep = [&]() {
+                scene.update_world_matrices();
+            };
+            auto on_demand = [&]() {
+                for (Scene::Transform *t = scene.first_transform; t != nullptr; t = t->alloc_next) {
+                    sink = sink + t->make_local_to_world()[3][0];
+                }
+            };
+
+            for (auto const &moved : {std::make_pair("all moved", &all), std::make_pair("1% moved", &some)}) {
+                double sweep_ms = time_frames(transforms, *moved.second, frames, sweep);
+                double on_demand_ms = time_frames(transforms, *moved.second, frames, on_demand);
+                std::cout << count << " transforms, " << (fan_out == 0 ? "flat" : "tree") << ", " << moved.first
+                          << ": update_world_matrices " << std::fixed << std::setprecision(3) << sweep_ms
+                          << " ms, on demand " << on_demand_ms << " ms per frame (" << std::setprecision(1)
+                          << on_demand_ms / sweep_ms << "x)" << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}